@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#define BOOT_STAGE_NUM 16
+
+typedef struct boot_stage
+{
+    const char *name;
+    int64_t time_us;
+} boot_stage_t;
+
+void boot_mark(const char *name);
+
+uint8_t boot_query_stages(boot_stage_t stages_out[BOOT_STAGE_NUM]);
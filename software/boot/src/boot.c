@@ -0,0 +1,44 @@
+#include "boot.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+static const char *const TAG = "Boot       ";
+
+// Stages are marked from app_main, the network event handler and the HTTP server task.
+static portMUX_TYPE stages_lock = portMUX_INITIALIZER_UNLOCKED;
+static boot_stage_t stages[BOOT_STAGE_NUM];
+static uint8_t stage_num = 0;
+
+void boot_mark(const char *name)
+{
+    int64_t now = esp_timer_get_time();
+    bool recorded = false;
+
+    portENTER_CRITICAL(&stages_lock);
+    if (stage_num < BOOT_STAGE_NUM)
+    {
+        stages[stage_num++] = (boot_stage_t){.name = name, .time_us = now};
+        recorded = true;
+    }
+    portEXIT_CRITICAL(&stages_lock);
+
+    if (recorded)
+        ESP_LOGI(TAG, "Stage \"%s\" reached after %" PRIu32 ".%03" PRIu32 " ms.", name, (uint32_t)(now / 1000), (uint32_t)(now % 1000));
+    else
+        ESP_LOGW(TAG, "Stage \"%s\" not recorded, all %u slots used.", name, BOOT_STAGE_NUM);
+}
+
+uint8_t boot_query_stages(boot_stage_t stages_out[BOOT_STAGE_NUM])
+{
+    portENTER_CRITICAL(&stages_lock);
+    uint8_t num = stage_num;
+    memcpy(stages_out, stages, num * sizeof(boot_stage_t));
+    portEXIT_CRITICAL(&stages_lock);
+
+    return num;
+}
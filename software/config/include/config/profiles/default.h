@@ -1,5 +1,7 @@
 #pragma once
 
+#include "config/secrets.h"
+
 #include "esp_mac.h"
 #include "esp_wifi.h"
 #include "hal/gpio_types.h"
@@ -8,6 +10,10 @@
 
 #define CONFIG_NETWORK_FALLBACK_TIMEOUT_SEC 10
 
+// Keeps Wi-Fi associated in power save while Ethernet is up and switches the default route on link loss.
+// The fallback timeout is not used then. Requires a CONFIG_ETHERNET_MAC_ADDRESS other than ESP_MAC_WIFI_STA.
+#define CONFIG_NETWORK_FAILOVER_ENABLE
+
 #define CONFIG_ETHERNET_SPI_HOST 1
 #define CONFIG_ETHERNET_SPI_CLOCK_MHZ 80
 
@@ -18,29 +24,68 @@
 #define CONFIG_ETHERNET_SPI_PIN_INT GPIO_NUM_9
 #define CONFIG_ETHERNET_SPI_PIN_RST GPIO_NUM_14
 
-#define CONFIG_ETHERNET_MAC_ADDRESS ESP_MAC_WIFI_STA
+#define CONFIG_ETHERNET_MAC_ADDRESS ESP_MAC_ETH
+#define CONFIG_ETHERNET_LINK_CHECK_MS 100
+#define CONFIG_ETHERNET_ROUTE_PRIO 128
+
+// Static addresses skip DHCP, otherwise the last lease is requested again after a reboot.
+// #define CONFIG_ETHERNET_STATIC_IP "192.168.1.20"
+#define CONFIG_ETHERNET_STATIC_NETMASK "255.255.255.0"
+#define CONFIG_ETHERNET_STATIC_GATEWAY "192.168.1.1"
+#define CONFIG_ETHERNET_STATIC_DNS "192.168.1.1"
 
 #define CONFIG_WIFI_SSID "ssid"
 #define CONFIG_WIFI_PASSPHRASE "pass"
 #define CONFIG_WIFI_AUTHENTICATION WIFI_AUTH_WPA2_PSK
 #define CONFIG_WIFI_RECONNECT_TIMEOUT_SEC 30
+#define CONFIG_WIFI_STANDBY_LISTEN_INTERVAL 10
+
+// #define CONFIG_WIFI_STATIC_IP "192.168.1.21"
+#define CONFIG_WIFI_STATIC_NETMASK "255.255.255.0"
+#define CONFIG_WIFI_STATIC_GATEWAY "192.168.1.1"
+#define CONFIG_WIFI_STATIC_DNS "192.168.1.1"
 
 #pragma endregion Network
 
 #pragma region HTTP
 
 #define CONFIG_HTTP_SERVER_PORT 80
+#define CONFIG_HTTP_MAX_URI_HANDLERS 16
+#define CONFIG_HTTP_MAX_OPEN_SOCKETS 12
+
+#define CONFIG_HTTP_KEEP_ALIVE_IDLE_TIMEOUT_SEC 10
+#define CONFIG_HTTP_KEEP_ALIVE_MAX_REQUESTS 100
+#define CONFIG_HTTP_KEEP_ALIVE_SWEEP_MS 1000
 
 #define CONFIG_INDEX_TITLE "RCS"
 
 #define CONFIG_STATUS_URI "/status"
+#define CONFIG_STATUS_QUEUE_URI "/status/queue"
+#define CONFIG_STATUS_BOOT_URI "/status/boot"
+
+#define CONFIG_METRICS_URI "/metrics"
+#define CONFIG_TRACE_URI "/trace"
+
+#define CONFIG_LOG_URI "/log"
+
+#define CONFIG_EVENTS_URI "/events"
+#define CONFIG_EVENTS_MAX_SUBSCRIBERS 4
+#define CONFIG_EVENTS_BUFFER_SIZE 16
+#define CONFIG_EVENTS_RETRY_MS 50
 
 #define CONFIG_ACTIONS_OPEN_URI "/actions/open"
 #define CONFIG_ACTIONS_CLOSE_URI "/actions/close"
 #define CONFIG_ACTIONS_STOP_URI "/actions/stop"
+#define CONFIG_ACTIONS_POSITION_URI "/actions/position"
+#define CONFIG_ACTIONS_TILT_URI "/actions/tilt"
+#define CONFIG_ACTIONS_BATCH_URI "/actions/batch"
+#define CONFIG_ACTIONS_BATCH_MAX 16
 
 #define CONFIG_FLASH_URI "/flash"
 #define CONFIG_FLASH_BUFFER_SIZE 4096
+#define CONFIG_FLASH_RECEIVE_RETRIES 5
+#define CONFIG_FLASH_TASK_STACK_SIZE 4096
+#define CONFIG_FLASH_TASK_PRIORITY 1
 
 #pragma endregion HTTP
 
@@ -50,15 +95,81 @@
 
 #pragma endregion Update
 
+#pragma region Logging
+
+#define CONFIG_LOGGING_BUFFER_SLOTS 64
+#define CONFIG_LOGGING_DRAIN_MS 20
+#define CONFIG_LOGGING_TASK_STACK_SIZE 4096
+#define CONFIG_LOGGING_TASK_PRIORITY 1
+
+#define CONFIG_LOGGING_RATE_LIMIT 20
+#define CONFIG_LOGGING_RATE_WINDOW_MS 1000
+#define CONFIG_LOGGING_RATE_TAGS 24
+
+#define CONFIG_LOGGING_UART_ENABLE
+#define CONFIG_LOGGING_TAIL_SIZE 4096
+// #define CONFIG_LOGGING_SYSLOG_HOST "192.168.1.2"
+#define CONFIG_LOGGING_SYSLOG_PORT 514
+
+#pragma endregion Logging
+
+#pragma region MQTT
+
+#define CONFIG_MQTT_BROKER_URI "mqtt://192.168.1.2"
+// #define CONFIG_MQTT_USERNAME "rcs"
+#define CONFIG_MQTT_PASSWORD CONFIG_SECRET_MQTT_PASSWORD
+
+// Topics are "<prefix>/<node id>/<channel>/...", the node id defaults to "rcs-" and the end of the MAC address.
+// #define CONFIG_MQTT_NODE_ID "rcs-living-room"
+#define CONFIG_MQTT_TOPIC_PREFIX "rcs"
+#define CONFIG_MQTT_DISCOVERY_PREFIX "homeassistant"
+
+#define CONFIG_MQTT_QOS 1
+#define CONFIG_MQTT_KEEPALIVE_SEC 30
+
+#pragma endregion MQTT
+
+#pragma region UDP
+
+#define CONFIG_UDP_PORT 4210
+// Shared by all devices and senders, at least 16 characters.
+#define CONFIG_UDP_KEY CONFIG_SECRET_UDP_KEY
+
+// Up to four multicast groups, e.g. one for the whole house and one per floor.
+#define CONFIG_UDP_MULTICAST_GROUP0 "239.255.82.1"
+// #define CONFIG_UDP_MULTICAST_GROUP1 "239.255.82.2"
+// #define CONFIG_UDP_MULTICAST_GROUP2 "239.255.82.3"
+// #define CONFIG_UDP_MULTICAST_GROUP3 "239.255.82.4"
+
+// Commands are only run within this time of their timestamp, so the clocks of senders and devices have to be synchronized.
+#define CONFIG_UDP_SNTP_SERVER "pool.ntp.org"
+#define CONFIG_UDP_REPLAY_WINDOW_MS 2000
+// Commands remembered to answer retransmissions, more than this many within the replay window are rejected.
+#define CONFIG_UDP_REPLAY_CACHE_SIZE 32
+
+#define CONFIG_UDP_TASK_STACK_SIZE 4096
+#define CONFIG_UDP_TASK_PRIORITY 3
+
+#pragma endregion UDP
+
 #pragma region Controller
 
 #define CONFIG_CONTROLLER_CHANNEL_NUM 7
 
+#define CONFIG_CONTROLLER_TASK_STACK_SIZE 4096
+#define CONFIG_CONTROLLER_TASK_PRIORITY 2
+
+#define CONFIG_CONTROLLER_TRACE_ENABLE
+#define CONFIG_CONTROLLER_TRACE_SIZE 64
+
 // Channel 0
 #define CONFIG_CONTROLLER_CHANNEL0_ENABLE
 
 #define CONFIG_CONTROLLER_CHANNEL0_INDEX 0
 #define CONFIG_CONTROLLER_CHANNEL0_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL0_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL0_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL0_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL0_MOTOR_ENABLE GPIO_NUM_3
 #define CONFIG_CONTROLLER_CHANNEL0_MOTOR_DIRECTION GPIO_NUM_4
@@ -73,6 +184,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL1_INDEX 1
 #define CONFIG_CONTROLLER_CHANNEL1_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL1_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL1_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL1_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL1_MOTOR_ENABLE GPIO_NUM_7
 #define CONFIG_CONTROLLER_CHANNEL1_MOTOR_DIRECTION GPIO_NUM_8
@@ -87,6 +201,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL2_INDEX 2
 #define CONFIG_CONTROLLER_CHANNEL2_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL2_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL2_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL2_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL2_MOTOR_ENABLE GPIO_NUM_17
 #define CONFIG_CONTROLLER_CHANNEL2_MOTOR_DIRECTION GPIO_NUM_18
@@ -101,6 +218,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL3_INDEX 3
 #define CONFIG_CONTROLLER_CHANNEL3_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL3_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL3_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL3_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL3_MOTOR_ENABLE GPIO_NUM_47
 #define CONFIG_CONTROLLER_CHANNEL3_MOTOR_DIRECTION GPIO_NUM_33
@@ -115,6 +235,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL4_INDEX 4
 #define CONFIG_CONTROLLER_CHANNEL4_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL4_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL4_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL4_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL4_MOTOR_ENABLE GPIO_NUM_35
 #define CONFIG_CONTROLLER_CHANNEL4_MOTOR_DIRECTION GPIO_NUM_36
@@ -129,6 +252,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL5_INDEX 5
 #define CONFIG_CONTROLLER_CHANNEL5_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL5_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL5_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL5_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL5_MOTOR_ENABLE GPIO_NUM_39
 #define CONFIG_CONTROLLER_CHANNEL5_MOTOR_DIRECTION GPIO_NUM_40
@@ -143,6 +269,9 @@
 
 #define CONFIG_CONTROLLER_CHANNEL6_INDEX 6
 #define CONFIG_CONTROLLER_CHANNEL6_STOP_TIMEOUT_SEC 75
+#define CONFIG_CONTROLLER_CHANNEL6_TRAVEL_UP_MS 65000
+#define CONFIG_CONTROLLER_CHANNEL6_TRAVEL_DOWN_MS 60000
+#define CONFIG_CONTROLLER_CHANNEL6_TILT_TIME_MS 1200
 
 #define CONFIG_CONTROLLER_CHANNEL6_MOTOR_ENABLE GPIO_NUM_45
 #define CONFIG_CONTROLLER_CHANNEL6_MOTOR_DIRECTION GPIO_NUM_46
@@ -152,24 +281,46 @@
 #define CONFIG_CONTROLLER_CHANNEL6_SWITCH_DOWN GPIO_NUM_42
 #define CONFIG_CONTROLLER_CHANNEL6_SWITCH_INVERT 0
 
-// All Channels
-#define CONFIG_CHANNEL_LOOP_STACK_SIZE 4096
-#define CONFIG_CHANNEL_LOOP_TASK_PRIORITY 1
-#define CONFIG_CHANNEL_LOOP_QUEUE_SIZE 10
+// Group 0
+#define CONFIG_CONTROLLER_GROUP0_ENABLE
 
-#define CONFIG_CHANNEL_POLL_STACK_SIZE 2048
-#define CONFIG_CHANNEL_POLL_TASK_PRIORITY 1
+#define CONFIG_CONTROLLER_GROUP0_NAME "south"
+#define CONFIG_CONTROLLER_GROUP0_CHANNELS 0x07
 
+// Group 1
+#define CONFIG_CONTROLLER_GROUP1_ENABLE
+
+#define CONFIG_CONTROLLER_GROUP1_NAME "north"
+#define CONFIG_CONTROLLER_GROUP1_CHANNELS 0x78
+
+// Group 2
+// #define CONFIG_CONTROLLER_GROUP2_ENABLE
+
+#define CONFIG_CONTROLLER_GROUP2_NAME "group2"
+#define CONFIG_CONTROLLER_GROUP2_CHANNELS 0x00
+
+// Group 3
+// #define CONFIG_CONTROLLER_GROUP3_ENABLE
+
+#define CONFIG_CONTROLLER_GROUP3_NAME "group3"
+#define CONFIG_CONTROLLER_GROUP3_CHANNELS 0x00
+
+// All Groups
+#define CONFIG_CONTROLLER_GROUP_STAGGER_MS 250
+
+// All Channels
 #define CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE 1
 #define CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE 1
 
 #define CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS 15
 #define CONFIG_CHANNEL_MOTOR_REVERSING_DELAY_MS 500
 
+#define CONFIG_CHANNEL_POSITION_OVERRUN_MS 2000
+
 #define CONFIG_CHANNEL_SWITCH_UP_ACTIVE 0
 #define CONFIG_CHANNEL_SWITCH_DOWN_ACTIVE 0
 
-#define CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS 50
+#define CONFIG_CHANNEL_SWITCH_DEBOUNCE_MS 20
 #define CONFIG_CHANNEL_SWITCH_HOLD_DELAY_MS 250
 #define CONFIG_CHANNEL_SWITCH_CLICK_DELAY_MS 500
 
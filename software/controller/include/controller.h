@@ -2,16 +2,80 @@
 
 #include "controller/channel.h"
 
+#include "config.h"
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+#define CONTROLLER_CHANNEL_MASK(num) (1UL << (num))
+#define CONTROLLER_ALL_CHANNELS (CONTROLLER_CHANNEL_MASK(CONFIG_CONTROLLER_CHANNEL_NUM) - 1)
+
+ESP_EVENT_DECLARE_BASE(CONTROLLER_EVENT);
+
+typedef enum controller_event
+{
+    CONTROLLER_EVENT_STARTED,
+    CONTROLLER_EVENT_STOPPED,
+    CONTROLLER_EVENT_REVERSING,
+    CONTROLLER_EVENT_TIMEOUT,
+} controller_event_t;
+
+typedef struct controller_event_data
+{
+    uint8_t channel_num;
+    channel_event_t direction;
+    int64_t timestamp;
+} controller_event_data_t;
+
+typedef struct controller_queue_stats
+{
+    uint32_t posted;
+    uint32_t coalesced;
+    uint32_t dropped;
+    uint8_t depth;
+    uint8_t max_depth;
+} controller_queue_stats_t;
+
+typedef struct controller_channel_state
+{
+    channel_event_t commanded;
+    channel_event_t running;
+    bool moving;
+    int8_t position;
+    int8_t tilt;
+    int64_t changed_at;
+} controller_channel_state_t;
+
+typedef struct controller_snapshot
+{
+    uint32_t generation;
+    controller_channel_state_t channels[CONFIG_CONTROLLER_CHANNEL_NUM];
+} controller_snapshot_t;
+
 void controller_init();
 
-void controller_open(uint8_t channel_num, bool user_initiated);
-void controller_open_all(bool user_initiated);
+esp_err_t controller_register_event_handler(esp_event_handler_t handler, void *arg);
+
+esp_err_t controller_open(uint8_t channel_num, bool user_initiated);
+esp_err_t controller_open_all(bool user_initiated);
+
+esp_err_t controller_close(uint8_t channel_num, bool user_initiated);
+esp_err_t controller_close_all(bool user_initiated);
+
+esp_err_t controller_stop(uint8_t channel_num, bool user_initiated);
+esp_err_t controller_stop_all(bool user_initiated);
+
+esp_err_t controller_move(uint8_t channel_num, uint8_t position, bool user_initiated);
+esp_err_t controller_move_all(uint8_t position, bool user_initiated);
 
-void controller_close(uint8_t channel_num, bool user_initiated);
-void controller_close_all(bool user_initiated);
+esp_err_t controller_tilt(uint8_t channel_num, uint8_t angle, bool user_initiated);
+esp_err_t controller_tilt_all(uint8_t angle, bool user_initiated);
 
-void controller_stop(uint8_t channel_num, bool user_initiated);
-void controller_stop_all(bool user_initiated);
+esp_err_t controller_dispatch(uint32_t channel_mask, channel_event_t event, uint8_t value, bool user_initiated, uint32_t *accepted_out);
+esp_err_t controller_find_group(const char *name, uint32_t *channel_mask_out);
 
 int8_t controller_query(uint8_t channel_num);
-int8_t *controller_query_all();
+int8_t controller_query_position(uint8_t channel_num);
+int8_t controller_query_tilt(uint8_t channel_num);
+void controller_query_all(controller_snapshot_t *snapshot_out);
+esp_err_t controller_query_queue(uint8_t channel_num, controller_queue_stats_t *stats_out);
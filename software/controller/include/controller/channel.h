@@ -1,23 +1,63 @@
 #pragma once
 
 #include "hal/gpio_types.h"
-#include "esp_event_base.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/timers.h"
 
-ESP_EVENT_DECLARE_BASE(CHANNEL_EVENT);
+#define CHANNEL_NO_DEADLINE INT64_MAX
+#define CHANNEL_WAKE_BIT (1UL << 30)
+
+#define CHANNEL_POSITION_OPEN 0
+#define CHANNEL_POSITION_CLOSED 1000
+#define CHANNEL_POSITION_UNKNOWN -1
+#define CHANNEL_POSITION_NONE -1
+
+#define CHANNEL_TILT_CLOSED 0
+#define CHANNEL_TILT_OPEN 1000
+#define CHANNEL_TILT_MAX_ANGLE 90
+
 typedef enum channel_event
 {
     CHANNEL_EVENT_OPEN,
     CHANNEL_EVENT_CLOSE,
     CHANNEL_EVENT_STOP,
+    CHANNEL_EVENT_POSITION,
+    CHANNEL_EVENT_TILT,
 } channel_event_t;
 
+typedef struct channel_command
+{
+    channel_event_t event;
+    uint8_t value;
+    bool user_initiated;
+    uint16_t delay_ms;
+} channel_command_t;
+
+typedef enum motor_state
+{
+    MOTOR_STATE_IDLE,
+    MOTOR_STATE_BRAKING,
+    MOTOR_STATE_SWITCHING,
+    MOTOR_STATE_RUNNING,
+} motor_state_t;
+
+typedef enum switch_state
+{
+    SWITCH_STATE_IDLE,
+    SWITCH_STATE_PRESSED,
+    SWITCH_STATE_HELD,
+    SWITCH_STATE_CLICKED,
+    SWITCH_STATE_MOVING,
+    SWITCH_STATE_DOUBLE_CLICKED,
+} switch_state_t;
+
 typedef struct channel
 {
     const uint8_t index;
     const TickType_t stop_timeout_sec;
+    const uint32_t travel_up_ms;
+    const uint32_t travel_down_ms;
+    const uint32_t tilt_time_ms;
 
     const gpio_num_t motor_enable;
     const gpio_num_t motor_direction;
@@ -27,11 +67,37 @@ typedef struct channel
     const gpio_num_t switch_down;
     const uint8_t switch_invert;
 
-    esp_event_loop_handle_t event_loop;
-    TaskHandle_t poll_task;
-    TimerHandle_t stop_timer;
-
     channel_event_t last_user_event;
+    int64_t stop_deadline;
+
+    motor_state_t motor_state;
+    channel_event_t motor_target;
+    channel_event_t motor_last_run;
+    int64_t motor_stopped_at;
+    int64_t motor_start_after;
+    int64_t motor_deadline;
+
+    int16_t position;
+    int16_t position_target;
+    bool position_homing;
+    int64_t position_since;
+    int64_t position_deadline;
+
+    int16_t tilt;
+    int16_t tilt_target;
+    bool tilt_homing;
+    int64_t tilt_since;
+    int64_t tilt_deadline;
+    int64_t tilt_jitter_max_us;
+
+    switch_state_t switch_state;
+    uint8_t switch_direction;
+    uint8_t switch_pressed[2];
+    int64_t switch_debounce_deadline[2];
+    int64_t switch_deadline;
 } channel_t;
 
 void channel_init(channel_t *channel);
+void channel_handle(channel_t *channel, const channel_command_t *command, int64_t now);
+void channel_process(channel_t *channel, int64_t now);
+int64_t channel_next_deadline(const channel_t *channel);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "controller/channel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SWITCH_EDGE_BIT(index, direction) (1UL << ((index) * 2 + (direction)))
+
+void switch_init(channel_t *channel);
+void switch_start(channel_t *channel, TaskHandle_t task);
+void switch_process(channel_t *channel, uint32_t edges, int64_t now);
+int64_t switch_next_deadline(const channel_t *channel);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "config.h"
+
+#include "esp_err.h"
+
+#ifdef CONFIG_CONTROLLER_TRACE_ENABLE
+#define TRACE(channel_num, point) trace_record(channel_num, point)
+#else
+#define TRACE(channel_num, point) ((void)0)
+#endif
+
+#define TRACE_BUCKET_NUM 10
+
+typedef enum trace_point
+{
+    TRACE_INPUT_EDGE,
+    TRACE_COMMAND_ENQUEUE,
+    TRACE_HANDLER_START,
+    TRACE_COMMAND_SETTLED,
+    TRACE_RELAY_ENABLE,
+    TRACE_RELAY_DISABLE,
+    TRACE_RELAY_DIRECTION,
+    TRACE_STOP_TIMEOUT,
+} trace_point_t;
+
+typedef enum trace_latency
+{
+    TRACE_LATENCY_DISPATCH,
+    TRACE_LATENCY_ACTUATION,
+    TRACE_LATENCY_NUM,
+} trace_latency_t;
+
+typedef struct trace_entry
+{
+    int64_t timestamp;
+    trace_point_t point;
+} trace_entry_t;
+
+typedef struct trace_histogram
+{
+    uint32_t buckets[TRACE_BUCKET_NUM];
+    uint32_t count;
+    int64_t sum_us;
+} trace_histogram_t;
+
+extern const uint32_t trace_bucket_bounds_us[TRACE_BUCKET_NUM];
+
+void trace_record(uint8_t channel_num, trace_point_t point);
+esp_err_t trace_query_entry(uint8_t channel_num, uint8_t index, trace_entry_t *entry_out);
+esp_err_t trace_query_histogram(uint8_t channel_num, trace_latency_t latency, trace_histogram_t *histogram_out);
@@ -1,4 +1,5 @@
 #include "controller/channel.h"
+#include "controller/trace.h"
 
 #include "controller.h"
 
@@ -7,232 +8,513 @@
 #include "esp_log.h"
 #include "esp_event.h"
 #include "driver/gpio.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/timers.h"
-
-ESP_EVENT_DEFINE_BASE(CHANNEL_EVENT);
 
 static const char *const TAG = "Controller : Channel  ";
 
-static void motor_open_handler(void *, esp_event_base_t, int32_t, void *);
-static void motor_close_handler(void *, esp_event_base_t, int32_t, void *);
-static void motor_stop_handler(void *, esp_event_base_t, int32_t, void *);
-static inline void motor_stop_if_moving(channel_t *, uint8_t);
-static inline void motor_change_direction(channel_t *, uint8_t);
+static void channel_move(channel_t *, channel_event_t, int64_t);
+static channel_event_t channel_direction(const channel_t *);
+static void channel_notify(const channel_t *, controller_event_t, channel_event_t, int64_t);
+
+static void motor_retarget(channel_t *, channel_event_t, int64_t);
+static void motor_step(channel_t *, int64_t);
+static inline int64_t motor_braking_deadline(const channel_t *);
+static inline uint8_t motor_direction_level(const channel_t *, channel_event_t);
 
-static void poll_task_handler(void *);
-static inline void switch_poll(channel_t *, uint8_t, gpio_num_t, uint8_t, gpio_num_t, uint8_t);
+static void position_update(channel_t *, int64_t);
+static void position_plan(channel_t *, int64_t);
+static channel_event_t position_direction(const channel_t *);
 
-static void stop_timer_handler(TimerHandle_t);
+static void tilt_update(channel_t *, int64_t);
+static void tilt_plan(channel_t *, int64_t);
+static void tilt_finish(channel_t *, int64_t);
+static channel_event_t tilt_direction(const channel_t *);
 
 void channel_init(channel_t *channel)
 {
-    ESP_LOGI(TAG, "%u : Create event loop.", channel->index);
-    char loop_name[16];
-    snprintf(loop_name, 16, "channel%u_evts", channel->index);
+    ESP_LOGI(TAG, "%u : Reset state.", channel->index);
+    channel->last_user_event = CHANNEL_EVENT_STOP;
+    channel->stop_deadline = CHANNEL_NO_DEADLINE;
+
+    channel->motor_state = MOTOR_STATE_IDLE;
+    channel->motor_target = CHANNEL_EVENT_STOP;
+    channel->motor_last_run = CHANNEL_EVENT_STOP;
+    channel->motor_stopped_at = 0;
+    channel->motor_start_after = 0;
+    channel->motor_deadline = CHANNEL_NO_DEADLINE;
+
+    channel->position = CHANNEL_POSITION_UNKNOWN;
+    channel->position_target = CHANNEL_POSITION_NONE;
+    channel->position_homing = false;
+    channel->position_deadline = CHANNEL_NO_DEADLINE;
+
+    channel->tilt = CHANNEL_POSITION_UNKNOWN;
+    channel->tilt_target = CHANNEL_POSITION_NONE;
+    channel->tilt_homing = false;
+    channel->tilt_deadline = CHANNEL_NO_DEADLINE;
+    channel->tilt_jitter_max_us = 0;
+}
 
-    esp_event_loop_args_t event_loop_config = {
-        .task_name = loop_name,
-        .task_core_id = tskNO_AFFINITY,
-        .task_stack_size = CONFIG_CHANNEL_LOOP_STACK_SIZE,
-        .task_priority = CONFIG_CHANNEL_LOOP_TASK_PRIORITY,
-        .queue_size = CONFIG_CHANNEL_LOOP_QUEUE_SIZE,
-    };
+void channel_handle(channel_t *channel, const channel_command_t *command, int64_t now)
+{
+    TRACE(channel->index, TRACE_HANDLER_START);
 
-    ESP_ERROR_CHECK(esp_event_loop_create(&event_loop_config, &channel->event_loop));
+    // The pulse may have ended while the command was queued, settle that first.
+    if (now >= channel->tilt_deadline)
+        tilt_finish(channel, now);
 
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(channel->event_loop, CHANNEL_EVENT, CHANNEL_EVENT_OPEN, &motor_open_handler, channel, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(channel->event_loop, CHANNEL_EVENT, CHANNEL_EVENT_CLOSE, &motor_close_handler, channel, NULL));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register_with(channel->event_loop, CHANNEL_EVENT, CHANNEL_EVENT_STOP, &motor_stop_handler, channel, NULL));
+    if (channel->motor_state == MOTOR_STATE_RUNNING)
+        position_update(channel, now);
 
-    ESP_LOGI(TAG, "%u : Create poll task.", channel->index);
-    char task_name[16];
-    snprintf(task_name, 16, "channel%u_task", channel->index);
+    switch (command->event)
+    {
+    case CHANNEL_EVENT_OPEN:
+        ESP_LOGI(TAG, "%u : Opening...", channel->index);
+        channel->position_target = CHANNEL_POSITION_OPEN;
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+        break;
+
+    case CHANNEL_EVENT_CLOSE:
+        ESP_LOGI(TAG, "%u : Closing...", channel->index);
+        channel->position_target = CHANNEL_POSITION_CLOSED;
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+        break;
+
+    case CHANNEL_EVENT_POSITION:
+        ESP_LOGI(TAG, "%u : Moving to %u %%...", channel->index, command->value);
+        channel->position_target = command->value * 10;
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+        break;
+
+    case CHANNEL_EVENT_TILT:
+        ESP_LOGI(TAG, "%u : Tilting to %u deg...", channel->index, command->value);
+        channel->position_target = CHANNEL_POSITION_NONE;
+        channel->tilt_target = command->value * CHANNEL_TILT_OPEN / CHANNEL_TILT_MAX_ANGLE;
+        break;
+
+    case CHANNEL_EVENT_STOP:
+        ESP_LOGI(TAG, "%u : Stopped!", channel->index);
+        channel->position_target = CHANNEL_POSITION_NONE;
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+        break;
+
+    default:
+        return;
+    }
 
-    BaseType_t err = xTaskCreate(&poll_task_handler, task_name, CONFIG_CHANNEL_POLL_STACK_SIZE, channel, CONFIG_CHANNEL_POLL_TASK_PRIORITY, &channel->poll_task);
-    if (err != pdPASS)
-        ESP_ERROR_CHECK(ESP_FAIL);
+    channel->motor_start_after = now + command->delay_ms * 1000LL;
 
-    ESP_LOGI(TAG, "%u : Create stop timer.", channel->index);
-    char timer_name[16];
-    snprintf(timer_name, 16, "channel%u_timr", channel->index);
+    channel_event_t target = channel_direction(channel);
+    if (command->user_initiated)
+        channel->last_user_event = command->event == CHANNEL_EVENT_TILT ? CHANNEL_EVENT_STOP : target;
 
-    channel->stop_timer = xTimerCreate(timer_name, channel->stop_timeout_sec * 1000 / portTICK_PERIOD_MS, pdFALSE, channel, &stop_timer_handler);
+    channel_move(channel, target, now);
 
-    channel->last_user_event = CHANNEL_EVENT_STOP;
+    if (channel->motor_state == MOTOR_STATE_IDLE || channel->motor_state == MOTOR_STATE_RUNNING)
+        TRACE(channel->index, TRACE_COMMAND_SETTLED);
 }
 
-static void motor_open_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+void channel_process(channel_t *channel, int64_t now)
 {
-    channel_t *channel = (channel_t *)arg;
+    if (now >= channel->tilt_deadline)
+        tilt_finish(channel, now);
+
+    if (now >= channel->stop_deadline)
+    {
+        ESP_LOGI(TAG, "%u : Stop timeout reached.", channel->index);
+        TRACE(channel->index, TRACE_STOP_TIMEOUT);
+        channel_notify(channel, CONTROLLER_EVENT_TIMEOUT, channel->motor_last_run, now);
+        channel_move(channel, CHANNEL_EVENT_STOP, now);
+    }
+
+    if (now >= channel->position_deadline)
+    {
+        position_update(channel, now);
+        channel->position_deadline = CHANNEL_NO_DEADLINE;
 
-    ESP_LOGI(TAG, "%u : Opening...", channel->index);
-    xTimerReset(channel->stop_timer, 0);
+        if (channel->position_homing)
+        {
+            ESP_LOGI(TAG, "%u : End position found.", channel->index);
+            channel->position_homing = false;
+        }
+        else
+        {
+            ESP_LOGI(TAG, "%u : Target position reached.", channel->index);
+            channel->position_target = CHANNEL_POSITION_NONE;
+        }
 
-    if (*(bool *)data)
-        channel->last_user_event = CHANNEL_EVENT_OPEN;
+        channel_move(channel, channel_direction(channel), now);
+    }
 
-    motor_stop_if_moving(channel, CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE == channel->motor_invert);
-    motor_change_direction(channel, CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE == channel->motor_invert);
-    gpio_set_level(channel->motor_enable, CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+    while (now >= channel->motor_deadline)
+        motor_step(channel, now);
 }
 
-static void motor_close_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+int64_t channel_next_deadline(const channel_t *channel)
 {
-    channel_t *channel = (channel_t *)arg;
+    int64_t deadline = channel->stop_deadline;
+
+    if (channel->motor_deadline < deadline)
+        deadline = channel->motor_deadline;
 
-    ESP_LOGI(TAG, "%u : Closing...", channel->index);
-    xTimerReset(channel->stop_timer, 0);
+    if (channel->position_deadline < deadline)
+        deadline = channel->position_deadline;
 
-    if (*(bool *)data)
-        channel->last_user_event = CHANNEL_EVENT_CLOSE;
+    if (channel->tilt_deadline < deadline)
+        deadline = channel->tilt_deadline;
 
-    motor_stop_if_moving(channel, CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE != channel->motor_invert);
-    motor_change_direction(channel, CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE != channel->motor_invert);
-    gpio_set_level(channel->motor_enable, CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+    return deadline;
 }
 
-static void motor_stop_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+static void channel_move(channel_t *channel, channel_event_t target, int64_t now)
 {
-    channel_t *channel = (channel_t *)arg;
-
-    ESP_LOGI(TAG, "%u : Stopped!", channel->index);
-    xTimerStop(channel->stop_timer, 0);
+    if (target == CHANNEL_EVENT_STOP)
+    {
+        channel->position_target = CHANNEL_POSITION_NONE;
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+        channel->stop_deadline = CHANNEL_NO_DEADLINE;
+    }
+    else
+    {
+        channel->stop_deadline = now + channel->stop_timeout_sec * 1000000LL;
+    }
 
-    if (*(bool *)data)
-        channel->last_user_event = CHANNEL_EVENT_STOP;
+    if (channel->motor_state == MOTOR_STATE_RUNNING && target == channel->motor_last_run)
+    {
+        // Already moving the right way, only the distance left to travel changed.
+        position_plan(channel, now);
+        return;
+    }
 
-    gpio_set_level(channel->motor_enable, !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
-    motor_change_direction(channel, !CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE);
+    motor_retarget(channel, target, now);
 }
 
-static inline void motor_stop_if_moving(channel_t *channel, uint8_t direction)
+static channel_event_t channel_direction(const channel_t *channel)
 {
-    if (gpio_get_level(channel->motor_enable) != CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE ||
-        gpio_get_level(channel->motor_direction) == direction)
-        return;
+    if (channel->tilt_target != CHANNEL_POSITION_NONE)
+        return tilt_direction(channel);
 
-    gpio_set_level(channel->motor_enable, !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
-    vTaskDelay(CONFIG_CHANNEL_MOTOR_REVERSING_DELAY_MS / portTICK_PERIOD_MS);
+    return position_direction(channel);
 }
 
-static inline void motor_change_direction(channel_t *channel, uint8_t direction)
+static void channel_notify(const channel_t *channel, controller_event_t event, channel_event_t direction, int64_t now)
 {
-    vTaskDelay(CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS / portTICK_PERIOD_MS);
-    gpio_set_level(channel->motor_direction, direction);
-    vTaskDelay(CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS / portTICK_PERIOD_MS);
+    controller_event_data_t data = {
+        .channel_num = channel->index,
+        .direction = direction,
+        .timestamp = now,
+    };
+
+    // Never wait for listeners, actuation must not depend on them.
+    if (esp_event_post(CONTROLLER_EVENT, event, &data, sizeof(data), 0) != ESP_OK)
+        ESP_LOGD(TAG, "%u : Dropped event %d.", channel->index, event);
 }
 
-static void poll_task_handler(void *arg)
+static void motor_retarget(channel_t *channel, channel_event_t target, int64_t now)
 {
-    channel_t *channel = (channel_t *)arg;
+    channel_event_t previous_target = channel->motor_target;
+    channel->motor_target = target;
 
-    gpio_num_t switch_up = channel->switch_up;
-    gpio_num_t switch_down = channel->switch_down;
+    switch (channel->motor_state)
+    {
+    case MOTOR_STATE_IDLE:
+        if (target == CHANNEL_EVENT_STOP)
+            return;
+        break;
 
-    uint8_t switch_up_active = CONFIG_CHANNEL_SWITCH_UP_ACTIVE;
-    uint8_t switch_down_active = CONFIG_CHANNEL_SWITCH_DOWN_ACTIVE;
+    case MOTOR_STATE_SWITCHING:
+        if (target == previous_target)
+            return;
+        break;
 
-    if (channel->switch_invert)
-    {
-        switch_up = channel->switch_down;
-        switch_down = channel->switch_up;
+    case MOTOR_STATE_RUNNING:
+        if (target == channel->motor_last_run)
+            return;
 
-        switch_up_active = CONFIG_CHANNEL_SWITCH_DOWN_ACTIVE;
-        switch_down_active = CONFIG_CHANNEL_SWITCH_UP_ACTIVE;
+        // Cutting the motor never waits, whatever the new target is.
+        gpio_set_level(channel->motor_enable, !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+        TRACE(channel->index, TRACE_RELAY_DISABLE);
+        channel->motor_stopped_at = now;
+        if (target == CHANNEL_EVENT_STOP)
+            channel_notify(channel, CONTROLLER_EVENT_STOPPED, channel->motor_last_run, now);
+        else
+            channel_notify(channel, CONTROLLER_EVENT_REVERSING, target, now);
+
+        position_update(channel, now);
+        channel->position_deadline = CHANNEL_NO_DEADLINE;
+        channel->tilt_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    default:
+        break;
     }
 
-    ESP_LOGI(TAG, "%u : Start polling.", channel->index);
-    while (1)
+    channel->motor_state = MOTOR_STATE_BRAKING;
+    channel->motor_deadline = motor_braking_deadline(channel);
+
+    // A staggered group start holds the motor back until its turn.
+    if (target != CHANNEL_EVENT_STOP && channel->motor_deadline < channel->motor_start_after)
+        channel->motor_deadline = channel->motor_start_after;
+
+    while (now >= channel->motor_deadline)
+        motor_step(channel, now);
+}
+
+static void motor_step(channel_t *channel, int64_t now)
+{
+    switch (channel->motor_state)
     {
-        switch_poll(channel, 1, switch_up, switch_up_active, switch_down, switch_down_active);
-        vTaskDelay(CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS / portTICK_PERIOD_MS);
+    case MOTOR_STATE_BRAKING:
+        gpio_set_level(channel->motor_direction, motor_direction_level(channel, channel->motor_target));
+        TRACE(channel->index, TRACE_RELAY_DIRECTION);
 
-        switch_poll(channel, 0, switch_down, switch_down_active, switch_up, switch_up_active);
-        vTaskDelay(CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS / portTICK_PERIOD_MS);
+        if (channel->motor_target == CHANNEL_EVENT_STOP)
+        {
+            ESP_LOGD(TAG, "%u : Motor idle.", channel->index);
+            channel->motor_state = MOTOR_STATE_IDLE;
+            channel->motor_deadline = CHANNEL_NO_DEADLINE;
+            break;
+        }
+
+        ESP_LOGD(TAG, "%u : Motor switching direction.", channel->index);
+        channel->motor_state = MOTOR_STATE_SWITCHING;
+        channel->motor_deadline = now + CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS * 1000;
+        break;
+
+    case MOTOR_STATE_SWITCHING:
+        ESP_LOGD(TAG, "%u : Motor running.", channel->index);
+        gpio_set_level(channel->motor_enable, CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+        TRACE(channel->index, TRACE_RELAY_ENABLE);
+
+        channel->motor_state = MOTOR_STATE_RUNNING;
+        channel->motor_last_run = channel->motor_target;
+        channel->motor_deadline = CHANNEL_NO_DEADLINE;
+
+        channel->position_since = now;
+        channel->tilt_since = now;
+        position_plan(channel, now);
+
+        channel_notify(channel, CONTROLLER_EVENT_STARTED, channel->motor_last_run, now);
+        break;
+
+    default:
+        channel->motor_deadline = CHANNEL_NO_DEADLINE;
+        break;
     }
 }
 
-static inline void switch_poll(channel_t *channel, uint8_t direction,
-                               gpio_num_t primary_switch, uint8_t primary_switch_active,
-                               gpio_num_t secondary_switch, uint8_t secondary_switch_active)
+static inline int64_t motor_braking_deadline(const channel_t *channel)
 {
-    if (gpio_get_level(primary_switch) != primary_switch_active)
-        return;
+    // Only reversing needs the motor to come to a halt, otherwise just let the relays settle.
+    if (channel->motor_target != CHANNEL_EVENT_STOP &&
+        channel->motor_last_run != CHANNEL_EVENT_STOP &&
+        channel->motor_target != channel->motor_last_run)
+        return channel->motor_stopped_at + CONFIG_CHANNEL_MOTOR_REVERSING_DELAY_MS * 1000;
 
-    ESP_LOGI(TAG, "%u : %s : Switch pressed.", channel->index, direction ? " Up " : "Down");
+    return channel->motor_stopped_at + CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS * 1000;
+}
 
-    if (direction)
-        controller_open(channel->index, true);
-    else
-        controller_close(channel->index, true);
+static inline uint8_t motor_direction_level(const channel_t *channel, channel_event_t target)
+{
+    switch (target)
+    {
+    case CHANNEL_EVENT_OPEN:
+        return CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE == channel->motor_invert;
+
+    case CHANNEL_EVENT_CLOSE:
+        return CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE != channel->motor_invert;
+
+    default:
+        return !CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE;
+    }
+}
+
+static void position_update(channel_t *channel, int64_t now)
+{
+    bool opening = channel->motor_last_run == CHANNEL_EVENT_OPEN;
+    uint32_t travel_ms = opening ? channel->travel_up_ms : channel->travel_down_ms;
+    int64_t elapsed = now - channel->position_since;
 
-    vTaskDelay(CONFIG_CHANNEL_SWITCH_HOLD_DELAY_MS / portTICK_PERIOD_MS);
+    tilt_update(channel, now);
 
-    if (gpio_get_level(primary_switch) == primary_switch_active)
+    if (channel->position == CHANNEL_POSITION_UNKNOWN)
     {
-        ESP_LOGI(TAG, "%u : %s : Switch held.", channel->index, direction ? " Up " : "Down");
+        // Without a reference only a full run tells where the channel is.
+        if (elapsed < travel_ms * 1000LL)
+            return;
+
+        channel->position = opening ? CHANNEL_POSITION_OPEN : CHANNEL_POSITION_CLOSED;
+        channel->position_since = now;
+        return;
+    }
 
-        while (gpio_get_level(primary_switch) == primary_switch_active)
-            vTaskDelay(CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS / portTICK_PERIOD_MS);
+    // One permille of travel takes travel_ms microseconds, keep the remainder for the next update.
+    int64_t delta = elapsed / travel_ms;
+    channel->position_since += delta * travel_ms;
 
-        ESP_LOGI(TAG, "%u : %s : Switch hold released.", channel->index, direction ? " Up " : "Down");
+    int32_t position = channel->position + (opening ? -delta : delta);
+    if (position < CHANNEL_POSITION_OPEN)
+        position = CHANNEL_POSITION_OPEN;
+    else if (position > CHANNEL_POSITION_CLOSED)
+        position = CHANNEL_POSITION_CLOSED;
 
-        controller_stop(channel->index, true);
+    channel->position = position;
+}
+
+static void position_plan(channel_t *channel, int64_t now)
+{
+    channel->tilt_deadline = CHANNEL_NO_DEADLINE;
+
+    if (channel->tilt_target != CHANNEL_POSITION_NONE)
+    {
+        channel->position_deadline = CHANNEL_NO_DEADLINE;
+        tilt_plan(channel, now);
         return;
     }
 
-    ESP_LOGI(TAG, "%u : %s : Switch released.", channel->index, direction ? " Up " : "Down");
+    bool opening = channel->motor_last_run == CHANNEL_EVENT_OPEN;
+    uint32_t travel_ms = opening ? channel->travel_up_ms : channel->travel_down_ms;
+    int16_t target = channel->position_target;
+    bool end_target = target == CHANNEL_POSITION_OPEN || target == CHANNEL_POSITION_CLOSED;
 
-    uint32_t delay_count = 0;
-    uint8_t double_clicked = 0;
-    while (1)
+    if (target == CHANNEL_POSITION_NONE)
     {
-        if (gpio_get_level(primary_switch) == primary_switch_active)
-        {
-            if (double_clicked || delay_count * CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS >= CONFIG_CHANNEL_SWITCH_CLICK_DELAY_MS)
-                break;
+        channel->position_deadline = CHANNEL_NO_DEADLINE;
+        return;
+    }
 
-            ESP_LOGI(TAG, "%u : %s : Switch double clicked.", channel->index, direction ? " Up " : "Down");
+    int64_t remaining;
+    if (channel->position == CHANNEL_POSITION_UNKNOWN)
+    {
+        // Run into the end position first, the target is approached from there.
+        channel->position_homing = !end_target;
+        remaining = travel_ms * 1000LL - (now - channel->position_since) + CONFIG_CHANNEL_POSITION_OVERRUN_MS * 1000;
+    }
+    else
+    {
+        int16_t distance = target > channel->position ? target - channel->position : channel->position - target;
 
-            double_clicked = 1;
-            delay_count = 0;
+        channel->position_homing = false;
+        remaining = (int64_t)distance * travel_ms;
 
-            if (direction)
-                controller_open_all(true);
-            else
-                controller_close_all(true);
+        // Overrun end positions to correct the estimate against the end switch.
+        if (end_target)
+            remaining += CONFIG_CHANNEL_POSITION_OVERRUN_MS * 1000;
+    }
 
-            vTaskDelay(CONFIG_CHANNEL_SWITCH_HOLD_DELAY_MS / portTICK_PERIOD_MS);
-            continue;
-        }
+    channel->position_deadline = now + remaining;
+}
 
-        if (gpio_get_level(secondary_switch) == secondary_switch_active)
-            break;
+static channel_event_t position_direction(const channel_t *channel)
+{
+    int16_t target = channel->position_target;
+
+    if (target == CHANNEL_POSITION_NONE)
+        return CHANNEL_EVENT_STOP;
+
+    if (target == CHANNEL_POSITION_OPEN)
+        return CHANNEL_EVENT_OPEN;
+
+    if (target == CHANNEL_POSITION_CLOSED)
+        return CHANNEL_EVENT_CLOSE;
+
+    if (channel->position == CHANNEL_POSITION_UNKNOWN)
+        return target < (CHANNEL_POSITION_OPEN + CHANNEL_POSITION_CLOSED) / 2 ? CHANNEL_EVENT_OPEN : CHANNEL_EVENT_CLOSE;
+
+    if (target < channel->position)
+        return CHANNEL_EVENT_OPEN;
 
-        vTaskDelay(CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS / portTICK_PERIOD_MS);
-        if (++delay_count * CONFIG_CHANNEL_SWITCH_POLLING_DELAY_MS >= channel->stop_timeout_sec * 1000)
+    if (target > channel->position)
+        return CHANNEL_EVENT_CLOSE;
+
+    return CHANNEL_EVENT_STOP;
+}
+
+static void tilt_update(channel_t *channel, int64_t now)
+{
+    bool opening = channel->motor_last_run == CHANNEL_EVENT_OPEN;
+    int64_t elapsed = now - channel->tilt_since;
+
+    if (channel->tilt == CHANNEL_POSITION_UNKNOWN)
+    {
+        if (elapsed < channel->tilt_time_ms * 1000LL)
             return;
+
+        channel->tilt = opening ? CHANNEL_TILT_OPEN : CHANNEL_TILT_CLOSED;
+        channel->tilt_since = now;
+        return;
     }
 
-    ESP_LOGI(TAG, "%u : %s : Switch pressed again.", channel->index, direction ? " Up " : "Down");
+    // Slats turn before the channel starts travelling, so moving up opens them and moving down closes them.
+    int64_t delta = elapsed / channel->tilt_time_ms;
+    channel->tilt_since += delta * channel->tilt_time_ms;
 
-    if (double_clicked)
-        controller_stop_all(true);
+    int32_t tilt = channel->tilt + (opening ? delta : -delta);
+    if (tilt < CHANNEL_TILT_CLOSED)
+        tilt = CHANNEL_TILT_CLOSED;
+    else if (tilt > CHANNEL_TILT_OPEN)
+        tilt = CHANNEL_TILT_OPEN;
+
+    channel->tilt = tilt;
+}
+
+static void tilt_plan(channel_t *channel, int64_t now)
+{
+    int16_t target = channel->tilt_target;
+    int64_t duration;
+
+    if (channel->tilt == CHANNEL_POSITION_UNKNOWN)
+    {
+        // A full turn of the slats gives a reference to pulse from.
+        channel->tilt_homing = target != CHANNEL_TILT_CLOSED && target != CHANNEL_TILT_OPEN;
+        duration = channel->tilt_time_ms * 1000LL - (now - channel->tilt_since);
+    }
     else
-        controller_stop(channel->index, true);
+    {
+        channel->tilt_homing = false;
+        duration = (int64_t)(target > channel->tilt ? target - channel->tilt : channel->tilt - target) * channel->tilt_time_ms;
+    }
+
+    if (duration < 0)
+        duration = 0;
+
+    channel->tilt_deadline = now + duration;
+}
+
+static void tilt_finish(channel_t *channel, int64_t now)
+{
+    int64_t jitter = now - channel->tilt_deadline;
+    channel->tilt_deadline = CHANNEL_NO_DEADLINE;
 
-    vTaskDelay(CONFIG_CHANNEL_SWITCH_HOLD_DELAY_MS / portTICK_PERIOD_MS);
+    if (jitter > channel->tilt_jitter_max_us)
+        channel->tilt_jitter_max_us = jitter;
 
-    ESP_LOGI(TAG, "%u : %s : Switch released again.", channel->index, direction ? " Up " : "Down");
+    ESP_LOGD(TAG, "%u : Tilt pulse done. (%" PRId64 " us late, %" PRId64 " us max)", channel->index, jitter, channel->tilt_jitter_max_us);
+
+    if (channel->tilt_homing)
+        channel->tilt_homing = false;
+    else
+        channel->tilt_target = CHANNEL_POSITION_NONE;
+
+    // The homed slats decide the way back, an unknown tilt would plan the finished homing pulse again.
+    if (channel->motor_state == MOTOR_STATE_RUNNING)
+        position_update(channel, now);
+
+    // Cuts the motor like any other stop, or reverses it once the slats are homed.
+    channel_move(channel, channel_direction(channel), now);
 }
 
-static void stop_timer_handler(TimerHandle_t timer)
+static channel_event_t tilt_direction(const channel_t *channel)
 {
-    xTimerStop(timer, 0);
+    int16_t target = channel->tilt_target;
+
+    if (channel->tilt == CHANNEL_POSITION_UNKNOWN)
+        return target < (CHANNEL_TILT_CLOSED + CHANNEL_TILT_OPEN) / 2 ? CHANNEL_EVENT_CLOSE : CHANNEL_EVENT_OPEN;
+
+    if (target > channel->tilt)
+        return CHANNEL_EVENT_OPEN;
+
+    if (target < channel->tilt)
+        return CHANNEL_EVENT_CLOSE;
 
-    channel_t *channel = (channel_t *)pvTimerGetTimerID(timer);
-    ESP_LOGI(TAG, "%u : Stop timeout reached.", channel->index);
-    controller_stop(channel->index, false);
+    return CHANNEL_EVENT_STOP;
 }
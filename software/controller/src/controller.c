@@ -1,18 +1,39 @@
 #include "controller.h"
 
 #include "controller/channel.h"
+#include "controller/switch.h"
+#include "controller/trace.h"
 
 #include "config.h"
 
+#include <string.h>
+#include <stdatomic.h>
+
 #include "esp_log.h"
-#include "esp_event.h"
+#include "esp_timer.h"
+#include "esp_system.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define CONTROLLER_COMMAND_BIT (1UL << 31)
+#define CONTROLLER_MAILBOX_SIZE 2
+
+#define CONTROLLER_DEFINE_GROUP(num)                             \
+    (controller_group_t)                                         \
+    {                                                            \
+        .name = CONFIG_CONTROLLER_GROUP##num##_NAME,             \
+        .channel_mask = CONFIG_CONTROLLER_GROUP##num##_CHANNELS, \
+    }
 
 #define CONTROLLER_DEFINE_CHANNEL(num)                                         \
     [CONFIG_CONTROLLER_CHANNEL##num##_INDEX] = (channel_t)                     \
     {                                                                          \
         .index = CONFIG_CONTROLLER_CHANNEL##num##_INDEX,                       \
         .stop_timeout_sec = CONFIG_CONTROLLER_CHANNEL##num##_STOP_TIMEOUT_SEC, \
+        .travel_up_ms = CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_UP_MS,         \
+        .travel_down_ms = CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_DOWN_MS,     \
+        .tilt_time_ms = CONFIG_CONTROLLER_CHANNEL##num##_TILT_TIME_MS,         \
         .motor_enable = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_ENABLE,         \
         .motor_direction = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_DIRECTION,   \
         .motor_invert = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_INVERT,         \
@@ -21,8 +42,78 @@
         .switch_invert = CONFIG_CONTROLLER_CHANNEL##num##_SWITCH_INVERT,       \
     }
 
+// Travel and tilt times divide the elapsed run time into permille steps, so none of them may be zero.
+#define CONTROLLER_CHECK_CHANNEL(num)                                                                                              \
+    _Static_assert(CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_UP_MS > 0, "Travel up time of channel " #num " must not be zero.");     \
+    _Static_assert(CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_DOWN_MS > 0, "Travel down time of channel " #num " must not be zero."); \
+    _Static_assert(CONFIG_CONTROLLER_CHANNEL##num##_TILT_TIME_MS > 0, "Tilt time of channel " #num " must not be zero.")
+
+ESP_EVENT_DEFINE_BASE(CONTROLLER_EVENT);
+
+_Static_assert(CONFIG_CONTROLLER_CHANNEL_NUM * 2 <= 30, "Switch edges of all channels must fit into one task notification.");
+
+#ifdef CONFIG_CONTROLLER_CHANNEL0_ENABLE
+CONTROLLER_CHECK_CHANNEL(0);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL1_ENABLE
+CONTROLLER_CHECK_CHANNEL(1);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL2_ENABLE
+CONTROLLER_CHECK_CHANNEL(2);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL3_ENABLE
+CONTROLLER_CHECK_CHANNEL(3);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL4_ENABLE
+CONTROLLER_CHECK_CHANNEL(4);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL5_ENABLE
+CONTROLLER_CHECK_CHANNEL(5);
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL6_ENABLE
+CONTROLLER_CHECK_CHANNEL(6);
+#endif
+
+typedef struct controller_mailbox
+{
+    channel_command_t commands[CONTROLLER_MAILBOX_SIZE];
+    uint8_t depth;
+    controller_queue_stats_t stats;
+} controller_mailbox_t;
+
+typedef enum controller_enqueue_result
+{
+    CONTROLLER_ENQUEUE_QUEUED,
+    CONTROLLER_ENQUEUE_COALESCED,
+    CONTROLLER_ENQUEUE_DROPPED,
+} controller_enqueue_result_t;
+
+typedef struct controller_group
+{
+    const char *name;
+    uint32_t channel_mask;
+} controller_group_t;
+
 static const char *const TAG = "Controller ";
 
+static TaskHandle_t controller_task;
+static esp_timer_handle_t wake_timer;
+
+static controller_mailbox_t mailboxes[CONFIG_CONTROLLER_CHANNEL_NUM];
+static portMUX_TYPE mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Written by the controller task only, readers copy the buffer of the current generation.
+static controller_snapshot_t snapshots[2];
+static atomic_uint_fast32_t snapshot_generation;
+
+static void controller_task_handler(void *);
+static void controller_wake_handler(void *);
+static esp_err_t controller_post(uint8_t, channel_event_t, uint8_t, bool);
+static controller_enqueue_result_t controller_enqueue(uint8_t, const channel_command_t *);
+static uint8_t controller_take(uint8_t, channel_command_t *);
+static void controller_publish(int64_t);
+static void controller_read(uint8_t, controller_channel_state_t *);
+
 static channel_t channels[CONFIG_CONTROLLER_CHANNEL_NUM] = {
 #ifdef CONFIG_CONTROLLER_CHANNEL0_ENABLE
     CONTROLLER_DEFINE_CHANNEL(0),
@@ -47,15 +138,33 @@ static channel_t channels[CONFIG_CONTROLLER_CHANNEL_NUM] = {
 #endif
 };
 
+static const controller_group_t groups[] = {
+#ifdef CONFIG_CONTROLLER_GROUP0_ENABLE
+    CONTROLLER_DEFINE_GROUP(0),
+#endif
+#ifdef CONFIG_CONTROLLER_GROUP1_ENABLE
+    CONTROLLER_DEFINE_GROUP(1),
+#endif
+#ifdef CONFIG_CONTROLLER_GROUP2_ENABLE
+    CONTROLLER_DEFINE_GROUP(2),
+#endif
+#ifdef CONFIG_CONTROLLER_GROUP3_ENABLE
+    CONTROLLER_DEFINE_GROUP(3),
+#endif
+    {.name = NULL},
+};
+
 void controller_init()
 {
+    uint32_t free_heap = esp_get_free_heap_size();
+
     ESP_LOGI(TAG, "Configure GPIOs.");
     gpio_config_t switch_config = {
         .pin_bit_mask = 0,
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
     };
 
     gpio_config_t motor_config = {
@@ -77,70 +186,197 @@ void controller_init()
 
     ESP_LOGI(TAG, "Initialize channels.");
     for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
         channel_init(&channels[i]);
+        switch_init(&channels[i]);
+    }
+
+    controller_publish(esp_timer_get_time());
+
+    ESP_LOGI(TAG, "Create wake timer.");
+    esp_timer_create_args_t wake_timer_config = {
+        .callback = &controller_wake_handler,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "controller_wake",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&wake_timer_config, &wake_timer));
+
+    ESP_LOGI(TAG, "Create controller task.");
+    BaseType_t err = xTaskCreate(&controller_task_handler, "controller", CONFIG_CONTROLLER_TASK_STACK_SIZE, NULL, CONFIG_CONTROLLER_TASK_PRIORITY, &controller_task);
+    if (err != pdPASS)
+        ESP_ERROR_CHECK(ESP_FAIL);
+
+    ESP_LOGI(TAG, "Start switches.");
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        switch_start(&channels[i], controller_task);
+
+    ESP_LOGI(TAG, "Initialized %u channels using %" PRIu32 " bytes of heap.", CONFIG_CONTROLLER_CHANNEL_NUM, free_heap - esp_get_free_heap_size());
+}
+
+esp_err_t controller_register_event_handler(esp_event_handler_t handler, void *arg)
+{
+    return esp_event_handler_instance_register(CONTROLLER_EVENT, ESP_EVENT_ANY_ID, handler, arg, NULL);
 }
 
-void controller_open(uint8_t channel_num, bool user_initiated)
+esp_err_t controller_open(uint8_t channel_num, bool user_initiated)
 {
     if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
     {
         ESP_LOGE(TAG, "Tried opening channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
 
-    esp_event_post_to(channels[channel_num].event_loop, CHANNEL_EVENT, CHANNEL_EVENT_OPEN, &user_initiated, sizeof(user_initiated), 0);
+    return controller_post(channel_num, CHANNEL_EVENT_OPEN, 0, user_initiated);
 }
 
-void controller_open_all(bool user_initiated)
+esp_err_t controller_open_all(bool user_initiated)
 {
     ESP_LOGI(TAG, "Open all channels.");
 
-    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
-    {
-        controller_open(i, user_initiated);
-    }
+    return controller_dispatch(CONTROLLER_ALL_CHANNELS, CHANNEL_EVENT_OPEN, 0, user_initiated, NULL);
 }
 
-void controller_close(uint8_t channel_num, bool user_initiated)
+esp_err_t controller_close(uint8_t channel_num, bool user_initiated)
 {
     if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
     {
         ESP_LOGE(TAG, "Tried closing channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
 
-    esp_event_post_to(channels[channel_num].event_loop, CHANNEL_EVENT, CHANNEL_EVENT_CLOSE, &user_initiated, sizeof(user_initiated), 0);
+    return controller_post(channel_num, CHANNEL_EVENT_CLOSE, 0, user_initiated);
 }
 
-void controller_close_all(bool user_initiated)
+esp_err_t controller_close_all(bool user_initiated)
 {
     ESP_LOGI(TAG, "Close all channels.");
 
-    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
-    {
-        controller_close(i, user_initiated);
-    }
+    return controller_dispatch(CONTROLLER_ALL_CHANNELS, CHANNEL_EVENT_CLOSE, 0, user_initiated, NULL);
 }
 
-void controller_stop(uint8_t channel_num, bool user_initiated)
+esp_err_t controller_stop(uint8_t channel_num, bool user_initiated)
 {
     if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
     {
         ESP_LOGE(TAG, "Tried stopping channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
-        return;
+        return ESP_ERR_INVALID_ARG;
     }
 
-    esp_event_post_to(channels[channel_num].event_loop, CHANNEL_EVENT, CHANNEL_EVENT_STOP, &user_initiated, sizeof(user_initiated), 0);
+    return controller_post(channel_num, CHANNEL_EVENT_STOP, 0, user_initiated);
 }
 
-void controller_stop_all(bool user_initiated)
+esp_err_t controller_stop_all(bool user_initiated)
 {
     ESP_LOGI(TAG, "Stop all channels.");
 
+    return controller_dispatch(CONTROLLER_ALL_CHANNELS, CHANNEL_EVENT_STOP, 0, user_initiated, NULL);
+}
+
+esp_err_t controller_move(uint8_t channel_num, uint8_t position, bool user_initiated)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGE(TAG, "Tried moving channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (position > 100)
+    {
+        ESP_LOGE(TAG, "Tried moving channel %u to %u %%.", channel_num, position);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return controller_post(channel_num, CHANNEL_EVENT_POSITION, position, user_initiated);
+}
+
+esp_err_t controller_move_all(uint8_t position, bool user_initiated)
+{
+    ESP_LOGI(TAG, "Move all channels to %u %%.", position);
+
+    return controller_dispatch(CONTROLLER_ALL_CHANNELS, CHANNEL_EVENT_POSITION, position, user_initiated, NULL);
+}
+
+esp_err_t controller_dispatch(uint32_t channel_mask, channel_event_t event, uint8_t value, bool user_initiated, uint32_t *accepted_out)
+{
+    if (accepted_out != NULL)
+        *accepted_out = 0;
+
+    if (channel_mask & ~CONTROLLER_ALL_CHANNELS)
+    {
+        ESP_LOGE(TAG, "Tried dispatching to channels 0x%" PRIx32 " of %u.", channel_mask, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ((event == CHANNEL_EVENT_POSITION && value > 100) || (event == CHANNEL_EVENT_TILT && value > CHANNEL_TILT_MAX_ANGLE) || event > CHANNEL_EVENT_TILT)
+    {
+        ESP_LOGE(TAG, "Tried dispatching event %d with value %u.", event, value);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (controller_task == NULL)
+    {
+        ESP_LOGE(TAG, "Not initialized, dropped event %d for channels 0x%" PRIx32 ".", event, channel_mask);
+
+        taskENTER_CRITICAL(&mailbox_lock);
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        {
+            if (channel_mask & CONTROLLER_CHANNEL_MASK(i))
+                mailboxes[i].stats.dropped++;
+        }
+        taskEXIT_CRITICAL(&mailbox_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    channel_command_t command = {
+        .event = event,
+        .value = value,
+        .user_initiated = user_initiated,
+        .delay_ms = 0,
+    };
+
+    uint32_t accepted = 0;
+
+    // All channels are queued at once, so the controller task handles the group within a single wakeup.
+    taskENTER_CRITICAL(&mailbox_lock);
     for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
     {
-        controller_stop(i, user_initiated);
+        if (!(channel_mask & CONTROLLER_CHANNEL_MASK(i)))
+            continue;
+
+        // A coalesced command replaced an older one, it is handled like a queued one.
+        if (controller_enqueue(i, &command) != CONTROLLER_ENQUEUE_DROPPED)
+            accepted |= CONTROLLER_CHANNEL_MASK(i);
+
+        // Stagger motor starts to spread the inrush current of the whole group.
+        if (event != CHANNEL_EVENT_STOP)
+            command.delay_ms += CONFIG_CONTROLLER_GROUP_STAGGER_MS;
     }
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    if (accepted_out != NULL)
+        *accepted_out = accepted;
+
+    if (accepted != channel_mask)
+        ESP_LOGW(TAG, "Dropped event %d for channels 0x%" PRIx32 ", mailbox full.", event, channel_mask & ~accepted);
+
+    xTaskNotify(controller_task, CONTROLLER_COMMAND_BIT, eSetBits);
+    return ESP_OK;
+}
+
+esp_err_t controller_find_group(const char *name, uint32_t *channel_mask_out)
+{
+    for (const controller_group_t *group = groups; group->name != NULL; group++)
+    {
+        if (strcmp(group->name, name))
+            continue;
+
+        *channel_mask_out = group->channel_mask & CONTROLLER_ALL_CHANNELS;
+        return ESP_OK;
+    }
+
+    ESP_LOGE(TAG, "Tried finding unknown group \"%s\".", name);
+    return ESP_ERR_NOT_FOUND;
 }
 
 int8_t controller_query(uint8_t channel_num)
@@ -151,20 +387,287 @@ int8_t controller_query(uint8_t channel_num)
         return -1;
     }
 
-    return channels[channel_num].last_user_event;
+    controller_channel_state_t state;
+    controller_read(channel_num, &state);
+
+    return state.commanded;
 }
 
-int8_t *controller_query_all()
+int8_t controller_query_position(uint8_t channel_num)
 {
-    ESP_LOGI(TAG, "Query all channels.");
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGE(TAG, "Tried querying position of channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return -1;
+    }
+
+    controller_channel_state_t state;
+    controller_read(channel_num, &state);
+
+    return state.position;
+}
+
+esp_err_t controller_tilt(uint8_t channel_num, uint8_t angle, bool user_initiated)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGE(TAG, "Tried tilting channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (angle > CHANNEL_TILT_MAX_ANGLE)
+    {
+        ESP_LOGE(TAG, "Tried tilting channel %u to %u deg.", channel_num, angle);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return controller_post(channel_num, CHANNEL_EVENT_TILT, angle, user_initiated);
+}
+
+esp_err_t controller_tilt_all(uint8_t angle, bool user_initiated)
+{
+    ESP_LOGI(TAG, "Tilt all channels to %u deg.", angle);
+
+    return controller_dispatch(CONTROLLER_ALL_CHANNELS, CHANNEL_EVENT_TILT, angle, user_initiated, NULL);
+}
+
+int8_t controller_query_tilt(uint8_t channel_num)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGE(TAG, "Tried querying tilt of channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return -1;
+    }
+
+    controller_channel_state_t state;
+    controller_read(channel_num, &state);
+
+    return state.tilt;
+}
+
+void controller_query_all(controller_snapshot_t *snapshot_out)
+{
+    uint32_t generation;
+
+    // The writer always fills the other buffer, so a copy is only torn if a generation was published meanwhile.
+    do
+    {
+        generation = atomic_load_explicit(&snapshot_generation, memory_order_acquire);
+        *snapshot_out = snapshots[generation & 1];
+
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&snapshot_generation, memory_order_relaxed) != generation);
+}
+
+esp_err_t controller_query_queue(uint8_t channel_num, controller_queue_stats_t *stats_out)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGE(TAG, "Tried querying queue of channel %u of %u.", channel_num, CONFIG_CONTROLLER_CHANNEL_NUM);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    taskENTER_CRITICAL(&mailbox_lock);
+    *stats_out = mailboxes[channel_num].stats;
+    stats_out->depth = mailboxes[channel_num].depth;
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    return ESP_OK;
+}
+
+static void controller_task_handler(void *arg)
+{
+    ESP_LOGI(TAG, "Start scheduling.");
+    while (1)
+    {
+        int64_t next_deadline = CHANNEL_NO_DEADLINE;
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        {
+            int64_t deadline = channel_next_deadline(&channels[i]);
+            if (deadline < next_deadline)
+                next_deadline = deadline;
+
+            deadline = switch_next_deadline(&channels[i]);
+            if (deadline < next_deadline)
+                next_deadline = deadline;
+        }
+
+        // Ticks are far too coarse for relay timing, so the next deadline is armed on the high resolution timer.
+        TickType_t timeout = portMAX_DELAY;
+        esp_timer_stop(wake_timer);
+
+        if (next_deadline != CHANNEL_NO_DEADLINE)
+        {
+            int64_t delay = next_deadline - esp_timer_get_time();
+            if (delay > 0)
+                ESP_ERROR_CHECK(esp_timer_start_once(wake_timer, delay));
+            else
+                timeout = 0;
+        }
+
+        uint32_t notification = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notification, timeout);
+
+        int64_t now = esp_timer_get_time();
+
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        {
+            channel_command_t commands[CONTROLLER_MAILBOX_SIZE];
+            uint8_t depth = controller_take(i, commands);
 
-    static int8_t results[CONFIG_CONTROLLER_CHANNEL_NUM + 1];
-    results[CONFIG_CONTROLLER_CHANNEL_NUM] = -1;
+            for (uint8_t j = 0; j < depth; j++)
+                channel_handle(&channels[i], &commands[j], now);
+        }
+
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        {
+            switch_process(&channels[i], notification, now);
+            channel_process(&channels[i], now);
+        }
+
+        controller_publish(now);
+    }
+}
+
+static void controller_wake_handler(void *arg)
+{
+    xTaskNotify(controller_task, CHANNEL_WAKE_BIT, eSetBits);
+}
+
+static esp_err_t controller_post(uint8_t channel_num, channel_event_t event, uint8_t value, bool user_initiated)
+{
+    controller_mailbox_t *mailbox = &mailboxes[channel_num];
+    channel_command_t command = {
+        .event = event,
+        .value = value,
+        .user_initiated = user_initiated,
+        .delay_ms = 0,
+    };
+
+    if (controller_task == NULL)
+    {
+        ESP_LOGE(TAG, "Not initialized, dropped event %d for channel %u.", event, channel_num);
+
+        taskENTER_CRITICAL(&mailbox_lock);
+        mailbox->stats.dropped++;
+        taskEXIT_CRITICAL(&mailbox_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    taskENTER_CRITICAL(&mailbox_lock);
+    controller_enqueue_result_t result = controller_enqueue(channel_num, &command);
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    if (result == CONTROLLER_ENQUEUE_DROPPED)
+    {
+        ESP_LOGW(TAG, "Dropped event %d for channel %u, mailbox full.", event, channel_num);
+        return ESP_FAIL;
+    }
+
+    xTaskNotify(controller_task, CONTROLLER_COMMAND_BIT, eSetBits);
+    return ESP_OK;
+}
+
+static controller_enqueue_result_t controller_enqueue(uint8_t channel_num, const channel_command_t *command)
+{
+    controller_mailbox_t *mailbox = &mailboxes[channel_num];
+    controller_enqueue_result_t result = CONTROLLER_ENQUEUE_QUEUED;
+    mailbox->stats.posted++;
+
+    if (command->event == CHANNEL_EVENT_STOP)
+    {
+        // A stop makes every pending command obsolete, so it can never be crowded out.
+        mailbox->stats.coalesced += mailbox->depth;
+        if (mailbox->depth > 0)
+            result = CONTROLLER_ENQUEUE_COALESCED;
+
+        mailbox->depth = 0;
+    }
+    else if (mailbox->depth > 0 && mailbox->commands[mailbox->depth - 1].event != CHANNEL_EVENT_STOP)
+    {
+        // Only the newest movement matters, it replaces the stale one.
+        mailbox->stats.coalesced++;
+        mailbox->depth--;
+        result = CONTROLLER_ENQUEUE_COALESCED;
+    }
+
+    // Cannot happen with a stop and a movement at most, but a full mailbox must never overwrite a command.
+    if (mailbox->depth == CONTROLLER_MAILBOX_SIZE)
+    {
+        mailbox->stats.dropped++;
+        return CONTROLLER_ENQUEUE_DROPPED;
+    }
+
+    mailbox->commands[mailbox->depth++] = *command;
+    TRACE(channel_num, TRACE_COMMAND_ENQUEUE);
+    if (mailbox->depth > mailbox->stats.max_depth)
+        mailbox->stats.max_depth = mailbox->depth;
+
+    return result;
+}
+
+static uint8_t controller_take(uint8_t channel_num, channel_command_t *commands_out)
+{
+    controller_mailbox_t *mailbox = &mailboxes[channel_num];
+
+    taskENTER_CRITICAL(&mailbox_lock);
+    uint8_t depth = mailbox->depth;
+
+    for (uint8_t i = 0; i < depth; i++)
+        commands_out[i] = mailbox->commands[i];
+
+    mailbox->depth = 0;
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    return depth;
+}
+
+static void controller_publish(int64_t now)
+{
+    uint32_t generation = atomic_load_explicit(&snapshot_generation, memory_order_relaxed);
+    const controller_snapshot_t *current = &snapshots[generation & 1];
+    controller_snapshot_t *next = &snapshots[(generation + 1) & 1];
+    bool changed = false;
+
+    // Readers may still copy this buffer from two generations ago, they must see the last publish before these writes.
+    atomic_thread_fence(memory_order_release);
 
     for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
     {
-        results[i] = controller_query(i);
+        const channel_t *channel = &channels[i];
+        controller_channel_state_t *state = &next->channels[i];
+
+        state->commanded = channel->last_user_event;
+        state->running = channel->motor_state == MOTOR_STATE_RUNNING ? channel->motor_last_run : CHANNEL_EVENT_STOP;
+        state->moving = channel->motor_state != MOTOR_STATE_IDLE;
+        state->position = channel->position == CHANNEL_POSITION_UNKNOWN ? -1 : (channel->position + 5) / 10;
+        state->tilt = channel->tilt == CHANNEL_POSITION_UNKNOWN ? -1 : (channel->tilt * CHANNEL_TILT_MAX_ANGLE + CHANNEL_TILT_OPEN / 2) / CHANNEL_TILT_OPEN;
+        state->changed_at = current->channels[i].changed_at;
+
+        const controller_channel_state_t *previous = &current->channels[i];
+        if (generation == 0 ||
+            state->commanded != previous->commanded ||
+            state->running != previous->running ||
+            state->moving != previous->moving ||
+            state->position != previous->position ||
+            state->tilt != previous->tilt)
+        {
+            state->changed_at = now;
+            changed = true;
+        }
     }
 
-    return results;
+    if (!changed)
+        return;
+
+    next->generation = generation + 1;
+    atomic_store_explicit(&snapshot_generation, generation + 1, memory_order_release);
+}
+
+static void controller_read(uint8_t channel_num, controller_channel_state_t *state_out)
+{
+    controller_snapshot_t snapshot;
+    controller_query_all(&snapshot);
+
+    *state_out = snapshot.channels[channel_num];
 }
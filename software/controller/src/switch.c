@@ -0,0 +1,234 @@
+#include "controller/switch.h"
+#include "controller/trace.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SWITCH_UP 1
+#define SWITCH_DOWN 0
+
+static const char *const TAG = "Controller : Switch   ";
+
+static TaskHandle_t switch_task;
+
+static void switch_isr_handler(void *);
+
+static void switch_debounce(channel_t *, uint8_t, uint32_t, int64_t);
+static void switch_on_press(channel_t *, uint8_t, int64_t);
+static void switch_on_release(channel_t *, uint8_t, int64_t);
+static void switch_on_deadline(channel_t *, int64_t);
+
+static inline gpio_num_t switch_gpio(const channel_t *, uint8_t);
+static inline uint8_t switch_is_pressed(const channel_t *, uint8_t);
+
+void switch_init(channel_t *channel)
+{
+    ESP_LOGI(TAG, "%u : Read initial switch state.", channel->index);
+    for (uint8_t direction = SWITCH_DOWN; direction <= SWITCH_UP; direction++)
+    {
+        channel->switch_pressed[direction] = switch_is_pressed(channel, direction);
+        channel->switch_debounce_deadline[direction] = CHANNEL_NO_DEADLINE;
+    }
+
+    channel->switch_state = SWITCH_STATE_IDLE;
+    channel->switch_deadline = CHANNEL_NO_DEADLINE;
+}
+
+void switch_start(channel_t *channel, TaskHandle_t task)
+{
+    switch_task = task;
+
+    ESP_LOGI(TAG, "%u : Register switch interrupts.", channel->index);
+    for (uint8_t direction = SWITCH_DOWN; direction <= SWITCH_UP; direction++)
+        ESP_ERROR_CHECK(gpio_isr_handler_add(switch_gpio(channel, direction), &switch_isr_handler, (void *)(uintptr_t)SWITCH_EDGE_BIT(channel->index, direction)));
+}
+
+void switch_process(channel_t *channel, uint32_t edges, int64_t now)
+{
+    switch_debounce(channel, SWITCH_UP, edges, now);
+    switch_debounce(channel, SWITCH_DOWN, edges, now);
+
+    if (now >= channel->switch_deadline)
+        switch_on_deadline(channel, now);
+}
+
+int64_t switch_next_deadline(const channel_t *channel)
+{
+    int64_t deadline = channel->switch_deadline;
+
+    if (channel->switch_debounce_deadline[SWITCH_UP] < deadline)
+        deadline = channel->switch_debounce_deadline[SWITCH_UP];
+
+    if (channel->switch_debounce_deadline[SWITCH_DOWN] < deadline)
+        deadline = channel->switch_debounce_deadline[SWITCH_DOWN];
+
+    return deadline;
+}
+
+static void IRAM_ATTR switch_isr_handler(void *arg)
+{
+    TRACE(__builtin_ctz((uint32_t)(uintptr_t)arg) / 2, TRACE_INPUT_EDGE);
+
+    BaseType_t task_woken = pdFALSE;
+    xTaskNotifyFromISR(switch_task, (uint32_t)(uintptr_t)arg, eSetBits, &task_woken);
+
+    if (task_woken == pdTRUE)
+        portYIELD_FROM_ISR();
+}
+
+static void switch_debounce(channel_t *channel, uint8_t direction, uint32_t edges, int64_t now)
+{
+    // The first edge arms the debounce window, further bouncing within the window is ignored.
+    if ((edges & SWITCH_EDGE_BIT(channel->index, direction)) && channel->switch_debounce_deadline[direction] == CHANNEL_NO_DEADLINE)
+        channel->switch_debounce_deadline[direction] = now + CONFIG_CHANNEL_SWITCH_DEBOUNCE_MS * 1000;
+
+    if (now < channel->switch_debounce_deadline[direction])
+        return;
+
+    channel->switch_debounce_deadline[direction] = CHANNEL_NO_DEADLINE;
+
+    uint8_t pressed = switch_is_pressed(channel, direction);
+    if (pressed == channel->switch_pressed[direction])
+        return;
+
+    channel->switch_pressed[direction] = pressed;
+
+    if (pressed)
+        switch_on_press(channel, direction, now);
+    else
+        switch_on_release(channel, direction, now);
+}
+
+static void switch_on_press(channel_t *channel, uint8_t direction, int64_t now)
+{
+    switch (channel->switch_state)
+    {
+    case SWITCH_STATE_IDLE:
+        ESP_LOGI(TAG, "%u : %s : Switch pressed.", channel->index, direction ? " Up " : "Down");
+
+        if (direction)
+            controller_open(channel->index, true);
+        else
+            controller_close(channel->index, true);
+
+        channel->switch_state = SWITCH_STATE_PRESSED;
+        channel->switch_direction = direction;
+        channel->switch_deadline = now + CONFIG_CHANNEL_SWITCH_HOLD_DELAY_MS * 1000;
+        break;
+
+    case SWITCH_STATE_CLICKED:
+        if (direction == channel->switch_direction)
+        {
+            ESP_LOGI(TAG, "%u : %s : Switch double clicked.", channel->index, direction ? " Up " : "Down");
+
+            if (direction)
+                controller_open_all(true);
+            else
+                controller_close_all(true);
+
+            channel->switch_state = SWITCH_STATE_DOUBLE_CLICKED;
+            channel->switch_deadline = now + channel->stop_timeout_sec * 1000000LL;
+            break;
+        }
+        // fall through
+
+    case SWITCH_STATE_MOVING:
+        ESP_LOGI(TAG, "%u : %s : Switch pressed again.", channel->index, direction ? " Up " : "Down");
+        controller_stop(channel->index, true);
+
+        channel->switch_state = SWITCH_STATE_IDLE;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    case SWITCH_STATE_DOUBLE_CLICKED:
+        ESP_LOGI(TAG, "%u : %s : Switch pressed again.", channel->index, direction ? " Up " : "Down");
+        controller_stop_all(true);
+
+        channel->switch_state = SWITCH_STATE_IDLE;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    case SWITCH_STATE_PRESSED:
+    case SWITCH_STATE_HELD:
+        if (direction == channel->switch_direction)
+            break;
+
+        // Pressing both switches toggles the slats between closed and fully open.
+        ESP_LOGI(TAG, "%u : %s : Switch pressed together.", channel->index, direction ? " Up " : "Down");
+        controller_tilt(channel->index, controller_query_tilt(channel->index) >= CHANNEL_TILT_MAX_ANGLE / 2 ? 0 : CHANNEL_TILT_MAX_ANGLE, true);
+
+        channel->switch_state = SWITCH_STATE_IDLE;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void switch_on_release(channel_t *channel, uint8_t direction, int64_t now)
+{
+    if (direction != channel->switch_direction)
+        return;
+
+    switch (channel->switch_state)
+    {
+    case SWITCH_STATE_PRESSED:
+        ESP_LOGI(TAG, "%u : %s : Switch released.", channel->index, direction ? " Up " : "Down");
+
+        channel->switch_state = SWITCH_STATE_CLICKED;
+        channel->switch_deadline = now + CONFIG_CHANNEL_SWITCH_CLICK_DELAY_MS * 1000;
+        break;
+
+    case SWITCH_STATE_HELD:
+        ESP_LOGI(TAG, "%u : %s : Switch hold released.", channel->index, direction ? " Up " : "Down");
+        controller_stop(channel->index, true);
+
+        channel->switch_state = SWITCH_STATE_IDLE;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void switch_on_deadline(channel_t *channel, int64_t now)
+{
+    switch (channel->switch_state)
+    {
+    case SWITCH_STATE_PRESSED:
+        ESP_LOGI(TAG, "%u : %s : Switch held.", channel->index, channel->switch_direction ? " Up " : "Down");
+
+        channel->switch_state = SWITCH_STATE_HELD;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+
+    case SWITCH_STATE_CLICKED:
+        channel->switch_state = SWITCH_STATE_MOVING;
+        channel->switch_deadline = now + channel->stop_timeout_sec * 1000000LL;
+        break;
+
+    default:
+        channel->switch_state = SWITCH_STATE_IDLE;
+        channel->switch_deadline = CHANNEL_NO_DEADLINE;
+        break;
+    }
+}
+
+static inline gpio_num_t switch_gpio(const channel_t *channel, uint8_t direction)
+{
+    return direction != channel->switch_invert ? channel->switch_up : channel->switch_down;
+}
+
+static inline uint8_t switch_is_pressed(const channel_t *channel, uint8_t direction)
+{
+    uint8_t active = direction != channel->switch_invert ? CONFIG_CHANNEL_SWITCH_UP_ACTIVE : CONFIG_CHANNEL_SWITCH_DOWN_ACTIVE;
+    return gpio_get_level(switch_gpio(channel, direction)) == active;
+}
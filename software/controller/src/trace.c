@@ -0,0 +1,158 @@
+#include "controller/trace.h"
+
+#include "config.h"
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+const uint32_t trace_bucket_bounds_us[TRACE_BUCKET_NUM] = {100, 500, 1000, 5000, 10000, 25000, 50000, 100000, 500000, UINT32_MAX};
+
+#ifdef CONFIG_CONTROLLER_TRACE_ENABLE
+
+_Static_assert(CONFIG_CONTROLLER_TRACE_SIZE <= UINT8_MAX, "Trace ring index must fit into a byte.");
+
+typedef struct trace_ring
+{
+    trace_entry_t entries[CONFIG_CONTROLLER_TRACE_SIZE];
+    uint8_t head;
+    uint8_t count;
+
+    int64_t pending_edge;
+    int64_t pending_input;
+    int64_t pending_enqueue;
+
+    trace_histogram_t histograms[TRACE_LATENCY_NUM];
+} trace_ring_t;
+
+static DRAM_ATTR trace_ring_t rings[CONFIG_CONTROLLER_CHANNEL_NUM];
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static IRAM_ATTR void trace_observe(trace_histogram_t *, int64_t);
+
+// Called from the switch ISR as well, so everything in here has to stay in IRAM and must not block.
+void IRAM_ATTR trace_record(uint8_t channel_num, trace_point_t point)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+        return;
+
+    int64_t now = esp_timer_get_time();
+    trace_ring_t *ring = &rings[channel_num];
+
+    portENTER_CRITICAL_SAFE(&trace_lock);
+
+    ring->entries[ring->head] = (trace_entry_t){
+        .timestamp = now,
+        .point = point,
+    };
+
+    ring->head = (ring->head + 1) % CONFIG_CONTROLLER_TRACE_SIZE;
+    if (ring->count < CONFIG_CONTROLLER_TRACE_SIZE)
+        ring->count++;
+
+    switch (point)
+    {
+    case TRACE_INPUT_EDGE:
+        // Bouncing contacts raise several edges, only the first one of a burst counts.
+        if (now - ring->pending_edge > CONFIG_CHANNEL_SWITCH_DEBOUNCE_MS * 2000LL)
+            ring->pending_edge = now;
+        break;
+
+    case TRACE_COMMAND_ENQUEUE:
+        // A command caused by a switch is measured from the edge, otherwise from being queued.
+        ring->pending_enqueue = now;
+        ring->pending_input = now - ring->pending_edge <= CONFIG_CHANNEL_SWITCH_DEBOUNCE_MS * 2000LL ? ring->pending_edge : now;
+        ring->pending_edge = 0;
+        break;
+
+    case TRACE_HANDLER_START:
+        if (ring->pending_enqueue == 0)
+            break;
+
+        trace_observe(&ring->histograms[TRACE_LATENCY_DISPATCH], now - ring->pending_enqueue);
+        ring->pending_enqueue = 0;
+        break;
+
+    case TRACE_RELAY_ENABLE:
+    case TRACE_RELAY_DISABLE:
+    case TRACE_RELAY_DIRECTION:
+        if (ring->pending_input == 0)
+            break;
+
+        trace_observe(&ring->histograms[TRACE_LATENCY_ACTUATION], now - ring->pending_input);
+        ring->pending_input = 0;
+        break;
+
+    case TRACE_COMMAND_SETTLED:
+        // The command did not need the relays to switch, there is nothing to measure.
+        ring->pending_input = 0;
+        break;
+
+    default:
+        break;
+    }
+
+    portEXIT_CRITICAL_SAFE(&trace_lock);
+}
+
+esp_err_t trace_query_entry(uint8_t channel_num, uint8_t index, trace_entry_t *entry_out)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM)
+        return ESP_ERR_INVALID_ARG;
+
+    trace_ring_t *ring = &rings[channel_num];
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    portENTER_CRITICAL(&trace_lock);
+
+    // Index 0 is the oldest entry still in the ring.
+    if (index < ring->count)
+    {
+        *entry_out = ring->entries[(ring->head + CONFIG_CONTROLLER_TRACE_SIZE - ring->count + index) % CONFIG_CONTROLLER_TRACE_SIZE];
+        err = ESP_OK;
+    }
+
+    portEXIT_CRITICAL(&trace_lock);
+    return err;
+}
+
+esp_err_t trace_query_histogram(uint8_t channel_num, trace_latency_t latency, trace_histogram_t *histogram_out)
+{
+    if (channel_num >= CONFIG_CONTROLLER_CHANNEL_NUM || latency >= TRACE_LATENCY_NUM)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&trace_lock);
+    *histogram_out = rings[channel_num].histograms[latency];
+    portEXIT_CRITICAL(&trace_lock);
+
+    return ESP_OK;
+}
+
+static IRAM_ATTR void trace_observe(trace_histogram_t *histogram, int64_t latency_us)
+{
+    uint8_t bucket = 0;
+    while (bucket < TRACE_BUCKET_NUM - 1 && latency_us > trace_bucket_bounds_us[bucket])
+        bucket++;
+
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_us += latency_us;
+}
+
+#else
+
+void trace_record(uint8_t channel_num, trace_point_t point)
+{
+}
+
+esp_err_t trace_query_entry(uint8_t channel_num, uint8_t index, trace_entry_t *entry_out)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t trace_query_histogram(uint8_t channel_num, trace_latency_t latency, trace_histogram_t *histogram_out)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
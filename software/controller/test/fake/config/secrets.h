@@ -0,0 +1,3 @@
+#pragma once
+
+// Stands in for the secrets of the profiles, the controller does not use any of them.
@@ -0,0 +1,3 @@
+#pragma once
+
+// Only needed by the network settings of the profiles, which the controller never expands.
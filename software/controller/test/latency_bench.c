@@ -0,0 +1,105 @@
+#include "sim.h"
+
+#include "controller.h"
+#include "controller/trace.h"
+
+#include "config.h"
+
+#include <string.h>
+
+#define BENCH_COMMAND_NUM 20000
+#define BENCH_MAX_GAP_US 3000000
+
+static const char *const COMMAND_NAMES[] = {"open", "close", "stop", "position", "tilt"};
+
+static int64_t latencies[CHANNEL_EVENT_TILT + 1][BENCH_COMMAND_NUM];
+static size_t latency_num[CHANNEL_EVENT_TILT + 1];
+static size_t settled_num[CHANNEL_EVENT_TILT + 1];
+
+static uint32_t random_state = 0x12345678;
+
+static uint32_t bench_random(uint32_t limit)
+{
+    // xorshift32, so every run replays the same commands.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % limit;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    int64_t difference = *(const int64_t *)a - *(const int64_t *)b;
+    return (difference > 0) - (difference < 0);
+}
+
+static void bench_report(const char *name, int64_t *values, size_t count, size_t settled)
+{
+    if (count == 0)
+    {
+        printf("%-9s %6u commands, %6u without relay change\n", name, 0, (unsigned)settled);
+        return;
+    }
+
+    qsort(values, count, sizeof(values[0]), &compare_latency);
+    printf("%-9s %6u commands, %6u without relay change, min %7.3f ms, median %7.3f ms, p99 %7.3f ms, max %7.3f ms\n",
+           name, (unsigned)count, (unsigned)settled, values[0] / 1e3, values[count / 2] / 1e3, values[count * 99 / 100] / 1e3, values[count - 1] / 1e3);
+}
+
+int main()
+{
+    sim_start();
+
+    // Random commands at random times, the latency is taken from posting a command to the first relay it switches.
+    for (uint32_t i = 0; i < BENCH_COMMAND_NUM; i++)
+    {
+        if (i % 1000 == 0)
+            sim_clear();
+
+        channel_event_t event = bench_random(CHANNEL_EVENT_TILT + 1);
+        int64_t gap = bench_random(BENCH_MAX_GAP_US);
+        int64_t posted = esp_timer_get_time();
+
+        switch (event)
+        {
+        case CHANNEL_EVENT_POSITION:
+            controller_move(0, bench_random(101), true);
+            break;
+
+        case CHANNEL_EVENT_TILT:
+            controller_tilt(0, bench_random(CHANNEL_TILT_MAX_ANGLE + 1), true);
+            break;
+
+        default:
+            controller_dispatch(CONTROLLER_CHANNEL_MASK(0), event, 0, true, NULL);
+            break;
+        }
+
+        sim_advance(gap);
+
+        const sim_edge_t *enable = sim_gpio_find(sim_channels[0].motor_enable, posted);
+        const sim_edge_t *direction = sim_gpio_find(sim_channels[0].motor_direction, posted);
+        const sim_edge_t *first = enable == NULL || (direction != NULL && direction->time < enable->time) ? direction : enable;
+
+        if (first == NULL)
+            settled_num[event]++;
+        else
+            latencies[event][latency_num[event]++] = first->time - posted;
+    }
+
+    printf("Command to first relay transition over %u commands in %.1f simulated hours:\n", BENCH_COMMAND_NUM,
+           (esp_timer_get_time() - SIM_START_TIME_US) / 3.6e9);
+
+    for (channel_event_t event = CHANNEL_EVENT_OPEN; event <= CHANNEL_EVENT_TILT; event++)
+        bench_report(COMMAND_NAMES[event], latencies[event], latency_num[event], settled_num[event]);
+
+    trace_histogram_t histogram;
+    if (trace_query_histogram(0, TRACE_LATENCY_ACTUATION, &histogram) == ESP_OK && histogram.count > 0)
+    {
+        printf("Trace actuation histogram of channel 0, mean %.3f ms:\n", histogram.sum_us / 1e3 / histogram.count);
+        for (uint8_t i = 0; i < TRACE_BUCKET_NUM; i++)
+            printf("  <= %10" PRIu32 " us: %" PRIu32 "\n", trace_bucket_bounds_us[i], histogram.buckets[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,698 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SIM_TASK_NUM 4
+#define SIM_TIMER_NUM 16
+#define SIM_HANDLER_NUM 8
+
+#define SIM_DEFINE_CHANNEL(num)                                                \
+    [CONFIG_CONTROLLER_CHANNEL##num##_INDEX] = {                               \
+        .stop_timeout_sec = CONFIG_CONTROLLER_CHANNEL##num##_STOP_TIMEOUT_SEC, \
+        .travel_up_ms = CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_UP_MS,         \
+        .travel_down_ms = CONFIG_CONTROLLER_CHANNEL##num##_TRAVEL_DOWN_MS,     \
+        .tilt_time_ms = CONFIG_CONTROLLER_CHANNEL##num##_TILT_TIME_MS,         \
+        .motor_enable = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_ENABLE,         \
+        .motor_direction = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_DIRECTION,   \
+        .motor_invert = CONFIG_CONTROLLER_CHANNEL##num##_MOTOR_INVERT,         \
+        .switch_up = CONFIG_CONTROLLER_CHANNEL##num##_SWITCH_UP,               \
+        .switch_down = CONFIG_CONTROLLER_CHANNEL##num##_SWITCH_DOWN,           \
+        .switch_invert = CONFIG_CONTROLLER_CHANNEL##num##_SWITCH_INVERT,       \
+    }
+
+typedef enum sim_task_state
+{
+    SIM_TASK_READY,
+    SIM_TASK_RUNNING,
+    SIM_TASK_BLOCKED,
+    SIM_TASK_DELETED,
+} sim_task_state_t;
+
+struct sim_task
+{
+    TaskFunction_t function;
+    void *parameters;
+    const char *name;
+    pthread_t thread;
+    pthread_cond_t resume;
+    sim_task_state_t state;
+    uint32_t value;
+    bool is_notified;
+    int64_t wake_at;
+};
+
+struct sim_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool is_armed;
+    int64_t expiry;
+};
+
+typedef struct sim_handler
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} sim_handler_t;
+
+static const char *const TAG = "Simulation ";
+
+const sim_channel_t sim_channels[CONFIG_CONTROLLER_CHANNEL_NUM] = {
+#ifdef CONFIG_CONTROLLER_CHANNEL0_ENABLE
+    SIM_DEFINE_CHANNEL(0),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL1_ENABLE
+    SIM_DEFINE_CHANNEL(1),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL2_ENABLE
+    SIM_DEFINE_CHANNEL(2),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL3_ENABLE
+    SIM_DEFINE_CHANNEL(3),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL4_ENABLE
+    SIM_DEFINE_CHANNEL(4),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL5_ENABLE
+    SIM_DEFINE_CHANNEL(5),
+#endif
+#ifdef CONFIG_CONTROLLER_CHANNEL6_ENABLE
+    SIM_DEFINE_CHANNEL(6),
+#endif
+};
+
+// Guards everything below, the simulation thread waits on sim_yield while a task runs.
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_yield = PTHREAD_COND_INITIALIZER;
+static _Atomic int64_t sim_time = SIM_START_TIME_US;
+static __thread struct sim_task *current_task;
+
+static struct sim_task tasks[SIM_TASK_NUM];
+static size_t task_num;
+static struct sim_timer timers[SIM_TIMER_NUM];
+static size_t timer_num;
+
+static uint8_t gpio_levels[GPIO_NUM_MAX];
+static bool gpio_is_driven[GPIO_NUM_MAX];
+static gpio_mode_t gpio_modes[GPIO_NUM_MAX];
+static gpio_int_type_t gpio_intr_types[GPIO_NUM_MAX];
+static gpio_isr_t gpio_isr_handlers[GPIO_NUM_MAX];
+static void *gpio_isr_args[GPIO_NUM_MAX];
+
+static sim_edge_t edges[SIM_EDGE_LOG_SIZE];
+static size_t edge_num;
+
+static sim_event_t events[SIM_EVENT_LOG_SIZE];
+static size_t event_num;
+static size_t event_delivered;
+static sim_handler_t handlers[SIM_HANDLER_NUM];
+static size_t handler_num;
+
+static struct sim_task *sim_next_ready(void);
+static void *sim_task_entry(void *);
+static bool sim_deliver_events(void);
+static void sim_record_edge(gpio_num_t, uint8_t);
+
+void sim_start(void)
+{
+    controller_init();
+    sim_settle();
+}
+
+uint8_t sim_direction_level(uint8_t channel_num, channel_event_t direction)
+{
+    // Same levels as channel.c drives, the direction relay rests while stopped.
+    switch (direction)
+    {
+    case CHANNEL_EVENT_OPEN:
+        return CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE == sim_channels[channel_num].motor_invert;
+
+    case CHANNEL_EVENT_CLOSE:
+        return CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE != sim_channels[channel_num].motor_invert;
+
+    default:
+        return !CONFIG_CHANNEL_MOTOR_DIRECTION_ACTIVE;
+    }
+}
+
+void sim_settle(void)
+{
+    do
+    {
+        pthread_mutex_lock(&sim_lock);
+
+        struct sim_task *task;
+        while ((task = sim_next_ready()) != NULL)
+        {
+            task->state = SIM_TASK_RUNNING;
+            pthread_cond_signal(&task->resume);
+
+            while (task->state == SIM_TASK_RUNNING)
+                pthread_cond_wait(&sim_yield, &sim_lock);
+        }
+
+        pthread_mutex_unlock(&sim_lock);
+    } while (sim_deliver_events());
+}
+
+void sim_advance(int64_t duration_us)
+{
+    sim_advance_to(sim_time + duration_us);
+}
+
+void sim_advance_to(int64_t time_us)
+{
+    while (true)
+    {
+        sim_settle();
+
+        pthread_mutex_lock(&sim_lock);
+        int64_t next = INT64_MAX;
+
+        for (size_t i = 0; i < timer_num; i++)
+        {
+            if (timers[i].is_armed && timers[i].expiry < next)
+                next = timers[i].expiry;
+        }
+
+        for (size_t i = 0; i < task_num; i++)
+        {
+            if (tasks[i].state == SIM_TASK_BLOCKED && tasks[i].wake_at < next)
+                next = tasks[i].wake_at;
+        }
+
+        if (next > time_us)
+        {
+            if (time_us > sim_time)
+                sim_time = time_us;
+
+            pthread_mutex_unlock(&sim_lock);
+            break;
+        }
+
+        if (next > sim_time)
+            sim_time = next;
+
+        struct sim_timer *expired[SIM_TIMER_NUM];
+        size_t expired_num = 0;
+
+        for (size_t i = 0; i < timer_num; i++)
+        {
+            if (!timers[i].is_armed || timers[i].expiry > sim_time)
+                continue;
+
+            timers[i].is_armed = false;
+            expired[expired_num++] = &timers[i];
+        }
+
+        for (size_t i = 0; i < task_num; i++)
+        {
+            if (tasks[i].state == SIM_TASK_BLOCKED && tasks[i].wake_at <= sim_time)
+                tasks[i].state = SIM_TASK_READY;
+        }
+
+        pthread_mutex_unlock(&sim_lock);
+
+        // Callbacks run like on the esp_timer task, outside of the lock so they can notify tasks.
+        for (size_t i = 0; i < expired_num; i++)
+            expired[i]->callback(expired[i]->arg);
+    }
+
+    sim_settle();
+}
+
+void sim_gpio_input(gpio_num_t gpio_num, uint8_t level)
+{
+    SIM_CHECK(gpio_num >= 0 && gpio_num < GPIO_NUM_MAX);
+
+    pthread_mutex_lock(&sim_lock);
+    uint8_t previous = gpio_levels[gpio_num];
+    gpio_levels[gpio_num] = level;
+    gpio_is_driven[gpio_num] = true;
+
+    if (previous != level)
+        sim_record_edge(gpio_num, level);
+
+    gpio_int_type_t intr_type = gpio_intr_types[gpio_num];
+    gpio_isr_t isr_handler = gpio_isr_handlers[gpio_num];
+    pthread_mutex_unlock(&sim_lock);
+
+    if (previous == level || isr_handler == NULL)
+        return;
+
+    if (intr_type == GPIO_INTR_ANYEDGE || (intr_type == GPIO_INTR_POSEDGE && level) || (intr_type == GPIO_INTR_NEGEDGE && !level))
+        isr_handler(gpio_isr_args[gpio_num]);
+}
+
+size_t sim_gpio_edges(const sim_edge_t **edges_out)
+{
+    *edges_out = edges;
+    return edge_num;
+}
+
+const sim_edge_t *sim_gpio_find(gpio_num_t gpio_num, int64_t since_us)
+{
+    for (size_t i = 0; i < edge_num; i++)
+    {
+        if (edges[i].gpio_num == gpio_num && edges[i].time >= since_us)
+            return &edges[i];
+    }
+
+    return NULL;
+}
+
+size_t sim_events(const sim_event_t **events_out)
+{
+    *events_out = events;
+    return event_num;
+}
+
+void sim_clear(void)
+{
+    sim_settle();
+
+    pthread_mutex_lock(&sim_lock);
+    edge_num = 0;
+    event_num = 0;
+    event_delivered = 0;
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static struct sim_task *sim_next_ready(void)
+{
+    for (size_t i = 0; i < task_num; i++)
+    {
+        if (tasks[i].state == SIM_TASK_READY)
+            return &tasks[i];
+    }
+
+    return NULL;
+}
+
+static void *sim_task_entry(void *arg)
+{
+    struct sim_task *task = arg;
+    current_task = task;
+
+    pthread_mutex_lock(&sim_lock);
+    while (task->state != SIM_TASK_RUNNING)
+        pthread_cond_wait(&task->resume, &sim_lock);
+    pthread_mutex_unlock(&sim_lock);
+
+    task->function(task->parameters);
+
+    // FreeRTOS tasks must not return, this one is gone for good either way.
+    ESP_LOGE(TAG, "Task \"%s\" returned.", task->name);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static bool sim_deliver_events(void)
+{
+    bool delivered = false;
+
+    while (true)
+    {
+        pthread_mutex_lock(&sim_lock);
+        if (event_delivered >= event_num)
+        {
+            pthread_mutex_unlock(&sim_lock);
+            return delivered;
+        }
+
+        sim_event_t event = events[event_delivered++];
+        pthread_mutex_unlock(&sim_lock);
+
+        for (size_t i = 0; i < handler_num; i++)
+        {
+            if (handlers[i].base == event.base && (handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id))
+                handlers[i].handler(handlers[i].arg, event.base, event.id, event.data);
+        }
+
+        delivered = true;
+    }
+}
+
+static void sim_record_edge(gpio_num_t gpio_num, uint8_t level)
+{
+    if (edge_num >= SIM_EDGE_LOG_SIZE)
+    {
+        fprintf(stderr, "Edge log is full, call sim_clear more often.\n");
+        abort();
+    }
+
+    edges[edge_num++] = (sim_edge_t){
+        .time = sim_time,
+        .gpio_num = gpio_num,
+        .level = level,
+    };
+}
+
+void sim_log(char level, const char *tag, const char *format, ...)
+{
+    static int is_enabled = -1;
+    if (is_enabled < 0)
+        is_enabled = getenv("SIM_LOG") != NULL;
+
+    if (!is_enabled)
+        return;
+
+    char message[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    fprintf(stderr, "%c (%" PRId64 ") %s: %s\n", level, (int64_t)(sim_time / 1000), tag, message);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    pthread_mutex_lock(&sim_lock);
+    SIM_CHECK(timer_num < SIM_TIMER_NUM);
+
+    struct sim_timer *timer = &timers[timer_num++];
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    timer->is_armed = false;
+    pthread_mutex_unlock(&sim_lock);
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&sim_lock);
+    if (timer->is_armed)
+    {
+        err = ESP_ERR_INVALID_STATE;
+    }
+    else
+    {
+        timer->is_armed = true;
+        timer->expiry = sim_time + (int64_t)timeout_us;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return err;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t err = ESP_OK;
+
+    pthread_mutex_lock(&sim_lock);
+    if (!timer->is_armed)
+        err = ESP_ERR_INVALID_STATE;
+
+    timer->is_armed = false;
+    pthread_mutex_unlock(&sim_lock);
+
+    return err;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_time;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler,
+                                              void *event_handler_arg, esp_event_handler_instance_t *instance)
+{
+    pthread_mutex_lock(&sim_lock);
+    if (handler_num >= SIM_HANDLER_NUM)
+    {
+        pthread_mutex_unlock(&sim_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    handlers[handler_num++] = (sim_handler_t){
+        .base = event_base,
+        .id = event_id,
+        .handler = event_handler,
+        .arg = event_handler_arg,
+    };
+    pthread_mutex_unlock(&sim_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    SIM_CHECK(event_data_size <= SIM_EVENT_DATA_SIZE);
+
+    pthread_mutex_lock(&sim_lock);
+    if (event_num >= SIM_EVENT_LOG_SIZE)
+    {
+        fprintf(stderr, "Event log is full, call sim_clear more often.\n");
+        abort();
+    }
+
+    sim_event_t *event = &events[event_num++];
+    event->time = sim_time;
+    event->base = event_base;
+    event->id = event_id;
+    memset(event->data, 0, sizeof(event->data));
+    memcpy(event->data, event_data, event_data_size);
+    pthread_mutex_unlock(&sim_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    pthread_mutex_lock(&sim_lock);
+    for (int i = 0; i < GPIO_NUM_MAX; i++)
+    {
+        if (!(config->pin_bit_mask & (1ULL << i)))
+            continue;
+
+        gpio_modes[i] = config->mode;
+        gpio_intr_types[i] = config->intr_type;
+
+        // Inputs idle at their pull unless a test drives them already.
+        if (!gpio_is_driven[i])
+            gpio_levels[i] = config->mode == GPIO_MODE_INPUT && config->pull_up_en == GPIO_PULLUP_ENABLE;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&sim_lock);
+    SIM_CHECK(gpio_modes[gpio_num] & GPIO_MODE_OUTPUT);
+
+    if (gpio_levels[gpio_num] != !!level)
+    {
+        gpio_levels[gpio_num] = !!level;
+        sim_record_edge(gpio_num, !!level);
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return 0;
+
+    pthread_mutex_lock(&sim_lock);
+    int level = gpio_levels[gpio_num];
+    pthread_mutex_unlock(&sim_lock);
+
+    return level;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_NUM_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    pthread_mutex_lock(&sim_lock);
+    gpio_isr_handlers[gpio_num] = isr_handler;
+    gpio_isr_args[gpio_num] = args;
+    pthread_mutex_unlock(&sim_lock);
+
+    return ESP_OK;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameters, UBaseType_t priority, TaskHandle_t *created_task)
+{
+    pthread_mutex_lock(&sim_lock);
+    if (task_num >= SIM_TASK_NUM)
+    {
+        pthread_mutex_unlock(&sim_lock);
+        return pdFAIL;
+    }
+
+    struct sim_task *task = &tasks[task_num++];
+    task->function = function;
+    task->parameters = parameters;
+    task->name = name;
+    task->state = SIM_TASK_READY;
+    task->wake_at = INT64_MAX;
+    pthread_cond_init(&task->resume, NULL);
+    pthread_mutex_unlock(&sim_lock);
+
+    if (pthread_create(&task->thread, NULL, &sim_task_entry, task) != 0)
+        return pdFAIL;
+
+    if (created_task != NULL)
+        *created_task = task;
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // Only a task ending itself is supported, that is all the firmware does.
+    SIM_CHECK(task == NULL || task == current_task);
+
+    pthread_mutex_lock(&sim_lock);
+    current_task->state = SIM_TASK_DELETED;
+    pthread_cond_signal(&sim_yield);
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_exit(NULL);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    pthread_mutex_lock(&sim_lock);
+    switch (action)
+    {
+    case eSetBits:
+        task->value |= value;
+        break;
+
+    case eIncrement:
+        task->value++;
+        break;
+
+    case eSetValueWithOverwrite:
+        task->value = value;
+        break;
+
+    case eSetValueWithoutOverwrite:
+        if (task->is_notified)
+        {
+            pthread_mutex_unlock(&sim_lock);
+            return pdFAIL;
+        }
+
+        task->value = value;
+        break;
+
+    default:
+        break;
+    }
+
+    task->is_notified = true;
+    if (task->state == SIM_TASK_BLOCKED)
+        task->state = SIM_TASK_READY;
+    pthread_mutex_unlock(&sim_lock);
+
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *higher_priority_task_woken)
+{
+    BaseType_t result = xTaskNotify(task, value, action);
+
+    if (higher_priority_task_woken != NULL)
+        *higher_priority_task_woken = pdTRUE;
+
+    return result;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t *notification_value, TickType_t ticks_to_wait)
+{
+    struct sim_task *task = current_task;
+    SIM_CHECK(task != NULL);
+
+    pthread_mutex_lock(&sim_lock);
+    if (!task->is_notified)
+    {
+        task->value &= ~bits_to_clear_on_entry;
+
+        if (ticks_to_wait > 0)
+        {
+            task->wake_at = ticks_to_wait == portMAX_DELAY ? INT64_MAX : sim_time + ticks_to_wait * (1000000LL / configTICK_RATE_HZ);
+            task->state = SIM_TASK_BLOCKED;
+            pthread_cond_signal(&sim_yield);
+
+            while (task->state != SIM_TASK_RUNNING)
+                pthread_cond_wait(&task->resume, &sim_lock);
+        }
+    }
+
+    if (notification_value != NULL)
+        *notification_value = task->value;
+
+    BaseType_t result = task->is_notified ? pdTRUE : pdFALSE;
+    if (task->is_notified)
+    {
+        task->value &= ~bits_to_clear_on_exit;
+        task->is_notified = false;
+    }
+    pthread_mutex_unlock(&sim_lock);
+
+    return result;
+}
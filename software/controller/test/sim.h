@@ -0,0 +1,89 @@
+#pragma once
+
+#include "controller.h"
+
+#include "config.h"
+
+#include "driver/gpio.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The virtual clock starts a second after boot like the firmware, zero timestamps mean "none" in the trace.
+#define SIM_START_TIME_US 1000000LL
+
+// Timings of the configuration in virtual microseconds, as the tests step the clock.
+#define SIM_RELAY_DELAY_US (CONFIG_CHANNEL_MOTOR_RELAY_DELAY_MS * 1000LL)
+#define SIM_REVERSING_DELAY_US (CONFIG_CHANNEL_MOTOR_REVERSING_DELAY_MS * 1000LL)
+#define SIM_DEBOUNCE_US (CONFIG_CHANNEL_SWITCH_DEBOUNCE_MS * 1000LL)
+#define SIM_OVERRUN_US (CONFIG_CHANNEL_POSITION_OVERRUN_MS * 1000LL)
+#define SIM_STAGGER_US (CONFIG_CONTROLLER_GROUP_STAGGER_MS * 1000LL)
+
+#define SIM_EDGE_LOG_SIZE 65536
+#define SIM_EVENT_LOG_SIZE 4096
+#define SIM_EVENT_DATA_SIZE 32
+
+#define SIM_CHECK(condition)                                                                  \
+    do                                                                                        \
+    {                                                                                         \
+        if (!(condition))                                                                     \
+        {                                                                                     \
+            fprintf(stderr, "%s:%d: Check failed at %" PRId64 " us: %s\n", __FILE__, __LINE__, \
+                    esp_timer_get_time(), #condition);                                        \
+            exit(1);                                                                          \
+        }                                                                                     \
+    } while (0)
+
+typedef struct sim_channel
+{
+    uint32_t stop_timeout_sec;
+    uint32_t travel_up_ms;
+    uint32_t travel_down_ms;
+    uint32_t tilt_time_ms;
+    gpio_num_t motor_enable;
+    gpio_num_t motor_direction;
+    uint8_t motor_invert;
+    gpio_num_t switch_up;
+    gpio_num_t switch_down;
+    uint8_t switch_invert;
+} sim_channel_t;
+
+typedef struct sim_edge
+{
+    int64_t time;
+    gpio_num_t gpio_num;
+    uint8_t level;
+} sim_edge_t;
+
+typedef struct sim_event
+{
+    int64_t time;
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[SIM_EVENT_DATA_SIZE];
+} sim_event_t;
+
+// The settings of the active profile by channel index, to find the pins of a channel.
+extern const sim_channel_t sim_channels[CONFIG_CONTROLLER_CHANNEL_NUM];
+
+uint8_t sim_direction_level(uint8_t channel_num, channel_event_t direction);
+
+// The simulation runs on the thread calling these functions. Tasks only run within sim_settle, one at a time and
+// until they block, and the clock only moves within sim_advance, so every run of a test is the same.
+void sim_start(void);
+void sim_settle(void);
+void sim_advance(int64_t duration_us);
+void sim_advance_to(int64_t time_us);
+
+// Inputs raise their interrupt on the simulation thread when the level changes.
+void sim_gpio_input(gpio_num_t gpio_num, uint8_t level);
+size_t sim_gpio_edges(const sim_edge_t **edges_out);
+const sim_edge_t *sim_gpio_find(gpio_num_t gpio_num, int64_t since_us);
+
+size_t sim_events(const sim_event_t **events_out);
+void sim_clear(void);
@@ -0,0 +1,139 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#define SEQUENCE_US (SIM_REVERSING_DELAY_US + 2 * SIM_RELAY_DELAY_US)
+#define STEP_US 1000
+#define SETTLE_US 1000000
+
+static void dispatch(channel_event_t event)
+{
+    SIM_CHECK(controller_dispatch(CONTROLLER_CHANNEL_MASK(0), event, 0, true, NULL) == ESP_OK);
+    sim_settle();
+}
+
+static channel_event_t reverse(channel_event_t direction)
+{
+    return direction == CHANNEL_EVENT_OPEN ? CHANNEL_EVENT_CLOSE : CHANNEL_EVENT_OPEN;
+}
+
+static int64_t relay_settled(gpio_num_t gpio_num, int64_t since)
+{
+    int64_t settled = since;
+    for (const sim_edge_t *edge = sim_gpio_find(gpio_num, since); edge != NULL; edge = sim_gpio_find(gpio_num, edge->time + 1))
+        settled = edge->time;
+
+    return settled;
+}
+
+static const sim_edge_t *relay_find(gpio_num_t gpio_num, int64_t since, uint8_t level)
+{
+    for (const sim_edge_t *edge = sim_gpio_find(gpio_num, since); edge != NULL; edge = sim_gpio_find(gpio_num, edge->time + 1))
+    {
+        if (edge->level == level)
+            return edge;
+    }
+
+    return NULL;
+}
+
+static channel_event_t start_run()
+{
+    // Runs towards the middle, so the channel never reaches an end position within the sweep.
+    channel_event_t direction = controller_query_position(0) < 50 ? CHANNEL_EVENT_CLOSE : CHANNEL_EVENT_OPEN;
+
+    sim_clear();
+    dispatch(direction);
+    sim_advance(SETTLE_US);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_enable) == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+
+    return direction;
+}
+
+static int64_t test_stop_during_reversal()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+    int64_t worst = 0;
+
+    // A stop at any point of a reversal cuts the motor right away and rests the direction relay within one relay delay.
+    for (int64_t offset = 0; offset <= SEQUENCE_US + SIM_RELAY_DELAY_US; offset += STEP_US)
+    {
+        channel_event_t direction = start_run();
+        dispatch(reverse(direction));
+        sim_advance(offset);
+
+        int64_t posted = esp_timer_get_time();
+        dispatch(CHANNEL_EVENT_STOP);
+        SIM_CHECK(gpio_get_level(channel->motor_enable) != CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+
+        // The motor may have started at the very time of the stop, but never after it.
+        sim_advance(SETTLE_US);
+        SIM_CHECK(sim_gpio_find(channel->motor_enable, posted + 1) == NULL);
+        SIM_CHECK(gpio_get_level(channel->motor_direction) == sim_direction_level(0, CHANNEL_EVENT_STOP));
+        SIM_CHECK(controller_query(0) == CHANNEL_EVENT_STOP);
+
+        int64_t latency = relay_settled(channel->motor_direction, posted) - posted;
+        SIM_CHECK(latency <= SIM_RELAY_DELAY_US);
+        if (latency > worst)
+            worst = latency;
+    }
+
+    return worst;
+}
+
+static int64_t test_retarget_during_reversal()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+    int64_t worst = 0;
+
+    // Taking a reversal back starts the motor the old way again after both relays settled, it never runs the new way.
+    for (int64_t offset = 0; offset <= SEQUENCE_US + SIM_RELAY_DELAY_US; offset += STEP_US)
+    {
+        channel_event_t direction = start_run();
+        dispatch(reverse(direction));
+        sim_advance(offset);
+
+        bool reversed = gpio_get_level(channel->motor_enable) == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE;
+        int64_t posted = esp_timer_get_time();
+        dispatch(direction);
+
+        sim_advance(SETTLE_US);
+        SIM_CHECK(gpio_get_level(channel->motor_enable) == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+        SIM_CHECK(gpio_get_level(channel->motor_direction) == sim_direction_level(0, direction));
+        SIM_CHECK(controller_query(0) == (int)direction);
+
+        // Once the reversed run started, going back is a reversal of its own.
+        if (reversed)
+            continue;
+
+        const sim_edge_t *enable = relay_find(channel->motor_enable, posted, CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+        SIM_CHECK(enable != NULL);
+        SIM_CHECK(sim_gpio_find(channel->motor_enable, enable->time + 1) == NULL);
+
+        int64_t latency = enable->time - posted;
+        SIM_CHECK(latency <= 2 * SIM_RELAY_DELAY_US);
+        if (latency > worst)
+            worst = latency;
+    }
+
+    return worst;
+}
+
+int main()
+{
+    sim_start();
+
+    // Homes the channel, so the sweeps know where the middle is.
+    dispatch(CHANNEL_EVENT_OPEN);
+    sim_advance(sim_channels[0].travel_up_ms * 1000LL + SIM_OVERRUN_US + SETTLE_US);
+    SIM_CHECK(controller_query_position(0) == 0);
+
+    int64_t stop = test_stop_during_reversal();
+    int64_t retarget = test_retarget_during_reversal();
+
+    printf("Worst case over reversals in %d us steps: stop to relays at rest %.3f ms, take back to motor running %.3f ms.\n",
+           STEP_US, stop / 1e3, retarget / 1e3);
+    return 0;
+}
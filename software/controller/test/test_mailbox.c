@@ -0,0 +1,140 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#define SETTLE_US 1000000
+
+static controller_queue_stats_t queue_stats(uint8_t channel_num)
+{
+    controller_queue_stats_t stats;
+    SIM_CHECK(controller_query_queue(channel_num, &stats) == ESP_OK);
+
+    return stats;
+}
+
+static size_t motor_starts(uint8_t channel_num, int64_t since)
+{
+    size_t starts = 0;
+    for (const sim_edge_t *edge = sim_gpio_find(sim_channels[channel_num].motor_enable, since); edge != NULL;
+         edge = sim_gpio_find(sim_channels[channel_num].motor_enable, edge->time + 1))
+    {
+        if (edge->level == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE)
+            starts++;
+    }
+
+    return starts;
+}
+
+static void test_not_initialized()
+{
+    // Commands before the controller task runs are counted as dropped, nothing is queued for later.
+    SIM_CHECK(controller_stop(0, true) == ESP_ERR_INVALID_STATE);
+    SIM_CHECK(controller_dispatch(CONTROLLER_CHANNEL_MASK(0) | CONTROLLER_CHANNEL_MASK(1), CHANNEL_EVENT_OPEN, 0, true, NULL) == ESP_ERR_INVALID_STATE);
+
+    controller_queue_stats_t stats = queue_stats(0);
+    SIM_CHECK(stats.posted == 0 && stats.dropped == 2 && stats.depth == 0);
+    SIM_CHECK(queue_stats(1).dropped == 1);
+}
+
+static void test_coalesce()
+{
+    controller_queue_stats_t before = queue_stats(0);
+
+    // Only the newest movement is handled, the controller task never sees the ones it replaced.
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_open(0, true) == ESP_OK);
+    SIM_CHECK(controller_move(0, 40, true) == ESP_OK);
+    SIM_CHECK(controller_close(0, true) == ESP_OK);
+
+    controller_queue_stats_t stats = queue_stats(0);
+    SIM_CHECK(stats.depth == 1);
+    SIM_CHECK(stats.posted == before.posted + 3 && stats.coalesced == before.coalesced + 2);
+
+    sim_settle();
+    sim_advance(SETTLE_US);
+
+    SIM_CHECK(queue_stats(0).depth == 0);
+    SIM_CHECK(motor_starts(0, start) == 1);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_CLOSE));
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_CLOSE);
+}
+
+static void test_stop()
+{
+    controller_queue_stats_t before = queue_stats(0);
+
+    // A stop clears the mailbox, a movement after it is kept behind it.
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_open(0, true) == ESP_OK);
+    SIM_CHECK(controller_stop(0, true) == ESP_OK);
+
+    controller_queue_stats_t stats = queue_stats(0);
+    SIM_CHECK(stats.depth == 1 && stats.coalesced == before.coalesced + 1);
+
+    SIM_CHECK(controller_move(0, 40, true) == ESP_OK);
+    SIM_CHECK(controller_open(0, true) == ESP_OK);
+
+    stats = queue_stats(0);
+    SIM_CHECK(stats.depth == 2 && stats.max_depth == 2);
+    SIM_CHECK(stats.posted == before.posted + 4 && stats.coalesced == before.coalesced + 2);
+
+    // The stop cuts the running close, the open starts after the motor came to a halt.
+    sim_settle();
+    sim_advance(SIM_REVERSING_DELAY_US + SIM_RELAY_DELAY_US + SETTLE_US);
+
+    SIM_CHECK(queue_stats(0).depth == 0);
+    SIM_CHECK(motor_starts(0, start) == 1);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_OPEN));
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_OPEN);
+
+    // A stop last leaves the channel at rest, whatever was queued before it.
+    start = esp_timer_get_time();
+    SIM_CHECK(controller_close(0, true) == ESP_OK);
+    SIM_CHECK(controller_stop(0, true) == ESP_OK);
+    sim_settle();
+    sim_advance(SETTLE_US);
+
+    SIM_CHECK(motor_starts(0, start) == 0);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_enable) != CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_STOP));
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_STOP);
+}
+
+static void test_accepted()
+{
+    uint32_t mask = CONTROLLER_CHANNEL_MASK(0) | CONTROLLER_CHANNEL_MASK(1);
+    uint32_t accepted = 0;
+
+    // Channels whose command replaced a queued one accepted it as well, the mask tells which channels will act.
+    SIM_CHECK(controller_open(0, true) == ESP_OK);
+    SIM_CHECK(controller_dispatch(mask, CHANNEL_EVENT_CLOSE, 0, true, &accepted) == ESP_OK);
+    SIM_CHECK(accepted == mask);
+
+    SIM_CHECK(controller_dispatch(mask, CHANNEL_EVENT_STOP, 0, true, &accepted) == ESP_OK);
+    SIM_CHECK(accepted == mask);
+
+    SIM_CHECK(queue_stats(0).depth == 1 && queue_stats(1).depth == 1);
+    SIM_CHECK(queue_stats(0).dropped == 2 && queue_stats(1).dropped == 1);
+
+    // Invalid commands are not accepted by any channel.
+    SIM_CHECK(controller_dispatch(mask, CHANNEL_EVENT_POSITION, 101, true, &accepted) == ESP_ERR_INVALID_ARG);
+    SIM_CHECK(accepted == 0);
+
+    sim_settle();
+    sim_advance(SETTLE_US);
+}
+
+int main()
+{
+    test_not_initialized();
+
+    sim_start();
+
+    test_coalesce();
+    test_stop();
+    test_accepted();
+
+    return 0;
+}
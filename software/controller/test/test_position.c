@@ -0,0 +1,148 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#define SETTLE_US 1000000
+
+static const sim_edge_t *motor_edge(uint8_t channel_num, int64_t since, bool enabled)
+{
+    for (const sim_edge_t *edge = sim_gpio_find(sim_channels[channel_num].motor_enable, since); edge != NULL;
+         edge = sim_gpio_find(sim_channels[channel_num].motor_enable, edge->time + 1))
+    {
+        if (edge->level == (enabled ? CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE : !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE))
+            return edge;
+    }
+
+    return NULL;
+}
+
+static uint8_t direction_at(uint8_t channel_num, int64_t time)
+{
+    // The direction relay rests from boot on, an edge only shows where its level changed.
+    uint8_t level = sim_direction_level(channel_num, CHANNEL_EVENT_STOP);
+    for (const sim_edge_t *edge = sim_gpio_find(sim_channels[channel_num].motor_direction, 0); edge != NULL && edge->time <= time;
+         edge = sim_gpio_find(sim_channels[channel_num].motor_direction, edge->time + 1))
+        level = edge->level;
+
+    return level;
+}
+
+static int64_t move(uint8_t position)
+{
+    sim_clear();
+
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_move(0, position, true) == ESP_OK);
+    sim_settle();
+
+    return start;
+}
+
+static void test_homing()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+
+    // Without a known position the channel first overruns the nearer end, then travels to the target from there.
+    int64_t start = move(30);
+    sim_advance((channel->travel_up_ms + channel->travel_down_ms) * 1000LL + SIM_OVERRUN_US + SETTLE_US);
+
+    const sim_edge_t *enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + channel->travel_up_ms * 1000LL + SIM_OVERRUN_US);
+
+    enable = motor_edge(0, disable->time, true);
+    SIM_CHECK(enable != NULL && enable->time == disable->time + SIM_REVERSING_DELAY_US + SIM_RELAY_DELAY_US);
+    SIM_CHECK(direction_at(0, enable->time) == sim_direction_level(0, CHANNEL_EVENT_CLOSE));
+
+    disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + 300LL * channel->travel_down_ms);
+    SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+
+    SIM_CHECK(controller_query_position(0) == 30);
+    SIM_CHECK(gpio_get_level(channel->motor_direction) == sim_direction_level(0, CHANNEL_EVENT_STOP));
+}
+
+static void test_target_reached()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+
+    // A known position is left for a target in between without any overrun, one permille takes travel_ms us.
+    int64_t start = move(75);
+    sim_advance(SIM_RELAY_DELAY_US + 100LL * channel->travel_down_ms);
+
+    // Retargeting the same way keeps the motor running and only moves the deadline.
+    int64_t retarget = esp_timer_get_time();
+    SIM_CHECK(controller_move(0, 60, true) == ESP_OK);
+    sim_settle();
+    SIM_CHECK(controller_query_position(0) == 40);
+    sim_advance(200LL * channel->travel_down_ms + SETTLE_US);
+
+    const sim_edge_t *enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == retarget + 200LL * channel->travel_down_ms);
+    SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+
+    SIM_CHECK(controller_query_position(0) == 60);
+
+    // Going back opens for the distance at the up speed.
+    start = move(45);
+    sim_advance(SIM_RELAY_DELAY_US + 150LL * channel->travel_up_ms + SETTLE_US);
+
+    enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+    SIM_CHECK(direction_at(0, enable->time) == sim_direction_level(0, CHANNEL_EVENT_OPEN));
+
+    disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + 150LL * channel->travel_up_ms);
+    SIM_CHECK(controller_query_position(0) == 45);
+
+    // Moving to where the channel already is does nothing.
+    start = move(45);
+    sim_advance(SETTLE_US);
+    SIM_CHECK(motor_edge(0, start, true) == NULL);
+}
+
+static void test_overrun()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+
+    // End positions are overrun to correct the estimate against the end switch.
+    int64_t start = move(100);
+    sim_advance(SIM_RELAY_DELAY_US + 550LL * channel->travel_down_ms + SIM_OVERRUN_US + SETTLE_US);
+
+    const sim_edge_t *enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + 550LL * channel->travel_down_ms + SIM_OVERRUN_US);
+    SIM_CHECK(controller_query_position(0) == 100);
+
+    // Even at the end position the overrun is run again, the estimate may have drifted.
+    start = move(100);
+    sim_advance(SIM_RELAY_DELAY_US + SIM_OVERRUN_US + SETTLE_US);
+
+    enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + SIM_OVERRUN_US);
+    SIM_CHECK(controller_query_position(0) == 100);
+}
+
+int main()
+{
+    sim_start();
+
+    test_homing();
+    test_target_reached();
+    test_overrun();
+
+    printf("Simulated %.1f s.\n", (esp_timer_get_time() - SIM_START_TIME_US) / 1e6);
+    return 0;
+}
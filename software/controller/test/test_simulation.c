@@ -0,0 +1,81 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+static void test_full_run()
+{
+    const sim_channel_t *channel = &sim_channels[0];
+
+    // Runs in the direction that moves the direction relay away from rest, so every step shows as an edge.
+    bool closing = sim_direction_level(0, CHANNEL_EVENT_CLOSE) != sim_direction_level(0, CHANNEL_EVENT_STOP);
+    int64_t travel_us = (closing ? channel->travel_down_ms : channel->travel_up_ms) * 1000LL;
+
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_dispatch(CONTROLLER_CHANNEL_MASK(0), closing ? CHANNEL_EVENT_CLOSE : CHANNEL_EVENT_OPEN, 0, true, NULL) == ESP_OK);
+    sim_settle();
+
+    // The direction relay switches right away, the motor only once it settled.
+    const sim_edge_t *direction = sim_gpio_find(channel->motor_direction, start);
+    SIM_CHECK(direction != NULL && direction->time == start);
+    SIM_CHECK(sim_gpio_find(channel->motor_enable, start) == NULL);
+
+    sim_advance(SIM_RELAY_DELAY_US);
+    const sim_edge_t *enable = sim_gpio_find(channel->motor_enable, start);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US && enable->level == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+
+    // Without a known position the channel runs into its end position and overruns it.
+    sim_advance(travel_us + SIM_OVERRUN_US + SIM_RELAY_DELAY_US);
+    enable = sim_gpio_find(channel->motor_enable, enable->time + 1);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US + travel_us + SIM_OVERRUN_US && enable->level != CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+
+    direction = sim_gpio_find(channel->motor_direction, direction->time + 1);
+    SIM_CHECK(direction != NULL && direction->time == enable->time + SIM_RELAY_DELAY_US && direction->level == sim_direction_level(0, CHANNEL_EVENT_STOP));
+
+    SIM_CHECK(controller_query_position(0) == (closing ? 100 : 0));
+    SIM_CHECK(controller_query(0) == (closing ? CHANNEL_EVENT_CLOSE : CHANNEL_EVENT_OPEN));
+
+    const sim_event_t *events;
+    size_t event_num = sim_events(&events);
+    SIM_CHECK(event_num == 2);
+    SIM_CHECK(events[0].id == CONTROLLER_EVENT_STARTED && events[0].time == start + SIM_RELAY_DELAY_US);
+    SIM_CHECK(events[1].id == CONTROLLER_EVENT_STOPPED && events[1].time == enable->time);
+}
+
+static void test_group_stagger()
+{
+    sim_clear();
+
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_dispatch(0x0e, CHANNEL_EVENT_OPEN, 0, true, NULL) == ESP_OK);
+    sim_advance(SIM_RELAY_DELAY_US + 3 * SIM_STAGGER_US);
+
+    // Motors of a group start one after the other to spread their inrush current.
+    for (uint8_t i = 1; i <= 3; i++)
+    {
+        const sim_edge_t *enable = sim_gpio_find(sim_channels[i].motor_enable, start);
+        SIM_CHECK(enable != NULL && enable->level == CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+        SIM_CHECK(enable->time == start + (i - 1) * SIM_STAGGER_US + SIM_RELAY_DELAY_US);
+    }
+
+    SIM_CHECK(controller_stop_all(true) == ESP_OK);
+    sim_settle();
+
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        SIM_CHECK(gpio_get_level(sim_channels[i].motor_enable) != CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE);
+}
+
+int main()
+{
+    sim_start();
+
+    const sim_edge_t *edges;
+    SIM_CHECK(sim_gpio_edges(&edges) == 0);
+
+    test_full_run();
+    test_group_stagger();
+
+    printf("Simulated %.1f s.\n", (esp_timer_get_time() - SIM_START_TIME_US) / 1e6);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define READER_NUM 4
+#define COMMAND_NUM 20000
+#define MAX_GAP_US 50000
+
+typedef struct reader
+{
+    pthread_t thread;
+    uint64_t reads;
+    uint32_t generations;
+} reader_t;
+
+static atomic_bool is_running = true;
+static uint32_t random_state = 0x2545f491;
+
+static uint32_t test_random(uint32_t limit)
+{
+    // xorshift32, so every run replays the same commands.
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state % limit;
+}
+
+static void *reader_run(void *arg)
+{
+    reader_t *reader = arg;
+    uint32_t last_generation = 0;
+
+    while (atomic_load_explicit(&is_running, memory_order_relaxed))
+    {
+        controller_snapshot_t snapshot;
+        controller_query_all(&snapshot);
+        reader->reads++;
+
+        SIM_CHECK(snapshot.generation >= last_generation);
+        if (snapshot.generation != last_generation)
+            reader->generations++;
+        last_generation = snapshot.generation;
+
+        // Commands always go to all channels at once, which the controller publishes within one generation.
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        {
+            const controller_channel_state_t *state = &snapshot.channels[i];
+            SIM_CHECK(state->commanded == snapshot.channels[0].commanded);
+            SIM_CHECK(state->running == CHANNEL_EVENT_STOP || state->moving);
+            SIM_CHECK(state->changed_at <= esp_timer_get_time());
+        }
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    sim_start();
+
+    reader_t readers[READER_NUM] = {0};
+    for (uint8_t i = 0; i < READER_NUM; i++)
+        SIM_CHECK(pthread_create(&readers[i].thread, NULL, &reader_run, &readers[i]) == 0);
+
+    // Runs stay far shorter than a full travel, so the positions stay unknown and every command moves all channels.
+    uint32_t published = 0;
+    for (uint32_t i = 0; i < COMMAND_NUM; i++)
+    {
+        if (i % 1000 == 0)
+            sim_clear();
+
+        channel_event_t event = test_random(CHANNEL_EVENT_STOP + 1);
+        SIM_CHECK(controller_dispatch(CONTROLLER_ALL_CHANNELS, event, 0, true, NULL) == ESP_OK);
+        sim_advance(test_random(MAX_GAP_US));
+
+        controller_snapshot_t snapshot;
+        controller_query_all(&snapshot);
+        SIM_CHECK(snapshot.channels[0].commanded == event);
+        published = snapshot.generation;
+    }
+
+    atomic_store_explicit(&is_running, false, memory_order_relaxed);
+
+    uint64_t reads = 0;
+    for (uint8_t i = 0; i < READER_NUM; i++)
+    {
+        SIM_CHECK(pthread_join(readers[i].thread, NULL) == 0);
+        reads += readers[i].reads;
+        SIM_CHECK(readers[i].generations > 0);
+    }
+
+    printf("%u readers took %" PRIu64 " consistent snapshots over %" PRIu32 " generations.\n", READER_NUM, reads, published);
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#define SWITCH_UP 1
+#define SWITCH_DOWN 0
+
+#define BOUNCE_US 1000
+
+static gpio_num_t switch_gpio(uint8_t channel_num, uint8_t direction)
+{
+    const sim_channel_t *channel = &sim_channels[channel_num];
+    return direction != channel->switch_invert ? channel->switch_up : channel->switch_down;
+}
+
+static uint8_t switch_level(uint8_t channel_num, uint8_t direction, bool pressed)
+{
+    uint8_t active = direction != sim_channels[channel_num].switch_invert ? CONFIG_CHANNEL_SWITCH_UP_ACTIVE : CONFIG_CHANNEL_SWITCH_DOWN_ACTIVE;
+    return pressed ? active : !active;
+}
+
+static int64_t switch_set(uint8_t channel_num, uint8_t direction, bool pressed)
+{
+    gpio_num_t gpio_num = switch_gpio(channel_num, direction);
+    int64_t start = esp_timer_get_time();
+
+    // Contacts bounce a few times before they settle, well within the debounce time.
+    for (uint8_t i = 0; i < 3; i++)
+    {
+        sim_gpio_input(gpio_num, switch_level(channel_num, direction, pressed));
+        sim_advance(BOUNCE_US);
+        sim_gpio_input(gpio_num, switch_level(channel_num, direction, !pressed));
+        sim_advance(BOUNCE_US);
+    }
+
+    sim_gpio_input(gpio_num, switch_level(channel_num, direction, pressed));
+    return start;
+}
+
+static const sim_edge_t *motor_edge(uint8_t channel_num, int64_t since, bool enabled)
+{
+    for (const sim_edge_t *edge = sim_gpio_find(sim_channels[channel_num].motor_enable, since); edge != NULL;
+         edge = sim_gpio_find(sim_channels[channel_num].motor_enable, edge->time + 1))
+    {
+        if (edge->level == (enabled ? CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE : !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE))
+            return edge;
+    }
+
+    return NULL;
+}
+
+static void idle(int64_t duration_us)
+{
+    sim_advance(duration_us);
+    sim_clear();
+}
+
+static void test_glitch()
+{
+    // A spike shorter than the debounce time is not a press.
+    int64_t start = esp_timer_get_time();
+    sim_gpio_input(switch_gpio(0, SWITCH_UP), switch_level(0, SWITCH_UP, true));
+    sim_advance(SIM_DEBOUNCE_US / 2);
+    sim_gpio_input(switch_gpio(0, SWITCH_UP), switch_level(0, SWITCH_UP, false));
+    sim_advance(1000000);
+
+    SIM_CHECK(motor_edge(0, start, true) == NULL);
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_STOP);
+    idle(0);
+}
+
+static void test_click()
+{
+    // A click moves the channel until the switch is pressed again.
+    int64_t pressed = switch_set(0, SWITCH_UP, true);
+    sim_advance(100000);
+    switch_set(0, SWITCH_UP, false);
+    sim_advance(2000000);
+
+    // The press is taken once the debounce time after the first edge passed, not on a polling period.
+    const sim_edge_t *enable = motor_edge(0, pressed, true);
+    SIM_CHECK(enable != NULL && enable->time == pressed + SIM_DEBOUNCE_US + SIM_RELAY_DELAY_US);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_OPEN));
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_OPEN);
+    SIM_CHECK(motor_edge(0, enable->time, false) == NULL);
+
+    int64_t stopped = switch_set(0, SWITCH_DOWN, true);
+    sim_advance(100000);
+    switch_set(0, SWITCH_DOWN, false);
+    sim_advance(100000);
+
+    const sim_edge_t *disable = motor_edge(0, stopped, false);
+    SIM_CHECK(disable != NULL && disable->time == stopped + SIM_DEBOUNCE_US);
+    SIM_CHECK(controller_query(0) == CHANNEL_EVENT_STOP);
+    idle(1000000);
+}
+
+static void test_hold()
+{
+    // Holding moves the channel until the switch is released. The last run opened, so closing has to wait for the motor.
+    int64_t pressed = switch_set(0, SWITCH_DOWN, true);
+    sim_advance(1000000);
+
+    const sim_edge_t *enable = motor_edge(0, pressed, true);
+    SIM_CHECK(enable != NULL && enable->time <= pressed + SIM_DEBOUNCE_US + SIM_REVERSING_DELAY_US);
+    SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_CLOSE));
+
+    int64_t released = switch_set(0, SWITCH_DOWN, false);
+    sim_advance(100000);
+
+    const sim_edge_t *disable = motor_edge(0, released, false);
+    SIM_CHECK(disable != NULL && disable->time == released + SIM_DEBOUNCE_US);
+    idle(1000000);
+
+    // No click is left pending after a hold.
+    SIM_CHECK(motor_edge(0, released, true) == NULL);
+}
+
+static void test_double_click()
+{
+    // A double click moves all channels, a further press stops them all.
+    int64_t pressed = switch_set(0, SWITCH_DOWN, true);
+    sim_advance(50000);
+    switch_set(0, SWITCH_DOWN, false);
+    sim_advance(50000);
+    int64_t pressed_again = switch_set(0, SWITCH_DOWN, true);
+    sim_advance(50000);
+    switch_set(0, SWITCH_DOWN, false);
+    sim_advance(3000000);
+
+    SIM_CHECK(motor_edge(0, pressed, true) != NULL);
+    for (uint8_t i = 1; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        const sim_edge_t *enable = motor_edge(i, pressed_again, true);
+        SIM_CHECK(enable != NULL && enable->time >= pressed_again + SIM_DEBOUNCE_US);
+        SIM_CHECK(controller_query(i) == CHANNEL_EVENT_CLOSE);
+    }
+
+    int64_t stopped = switch_set(0, SWITCH_UP, true);
+    sim_advance(100000);
+    switch_set(0, SWITCH_UP, false);
+    sim_advance(100000);
+
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        const sim_edge_t *disable = motor_edge(i, stopped, false);
+        SIM_CHECK(disable != NULL && disable->time == stopped + SIM_DEBOUNCE_US);
+    }
+
+    idle(1000000);
+}
+
+static void test_both_pressed()
+{
+    // Pressing the other switch while holding one tilts the slats. The hold before closed them, so they turn fully open.
+    int64_t pressed = switch_set(0, SWITCH_UP, true);
+    sim_advance(100000);
+    switch_set(0, SWITCH_DOWN, true);
+    sim_advance(100000);
+    switch_set(0, SWITCH_DOWN, false);
+    switch_set(0, SWITCH_UP, false);
+    sim_advance(5000000);
+
+    // The channel keeps running up into the tilt, which ends the run after a full turn of the slats, to a step of them.
+    const sim_edge_t *enable = motor_edge(0, pressed, true);
+    SIM_CHECK(enable != NULL);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL);
+    SIM_CHECK(llabs(disable->time - enable->time - sim_channels[0].tilt_time_ms * 1000LL) <= sim_channels[0].tilt_time_ms);
+    SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+    SIM_CHECK(controller_query_tilt(0) == CHANNEL_TILT_MAX_ANGLE);
+    idle(1000000);
+}
+
+int main()
+{
+    sim_start();
+
+    test_glitch();
+    test_click();
+    test_hold();
+    test_double_click();
+    test_both_pressed();
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include "sim.h"
+
+#include "controller.h"
+
+#include "config.h"
+
+#define SETTLE_US 1000000
+
+static const sim_edge_t *motor_edge(uint8_t channel_num, int64_t since, bool enabled)
+{
+    for (const sim_edge_t *edge = sim_gpio_find(sim_channels[channel_num].motor_enable, since); edge != NULL;
+         edge = sim_gpio_find(sim_channels[channel_num].motor_enable, edge->time + 1))
+    {
+        if (edge->level == (enabled ? CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE : !CONFIG_CHANNEL_MOTOR_ENABLE_ACTIVE))
+            return edge;
+    }
+
+    return NULL;
+}
+
+static int64_t tilt(uint8_t angle)
+{
+    sim_clear();
+
+    int64_t start = esp_timer_get_time();
+    SIM_CHECK(controller_tilt(0, angle, true) == ESP_OK);
+    sim_settle();
+
+    return start;
+}
+
+static int16_t tilt_permille(uint8_t angle)
+{
+    return angle * CHANNEL_TILT_OPEN / CHANNEL_TILT_MAX_ANGLE;
+}
+
+static void test_homing()
+{
+    int64_t step_us = sim_channels[0].tilt_time_ms;
+
+    // Without a known tilt the slats are turned fully open first, then pulsed back to the angle.
+    int64_t start = tilt(45);
+    sim_advance(SIM_RELAY_DELAY_US + CHANNEL_TILT_OPEN * step_us + SIM_REVERSING_DELAY_US + SIM_RELAY_DELAY_US +
+                tilt_permille(45) * step_us + SETTLE_US);
+
+    const sim_edge_t *enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + CHANNEL_TILT_OPEN * step_us);
+
+    enable = motor_edge(0, disable->time, true);
+    SIM_CHECK(enable != NULL && enable->time == disable->time + SIM_REVERSING_DELAY_US + SIM_RELAY_DELAY_US);
+
+    disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == enable->time + (CHANNEL_TILT_OPEN - tilt_permille(45)) * step_us);
+    SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+
+    SIM_CHECK(controller_query_tilt(0) == 45);
+}
+
+static void test_pulses()
+{
+    static const uint8_t angles[] = {44, 46, 1, 0, 90, 89, 30};
+    int64_t step_us = sim_channels[0].tilt_time_ms;
+    int16_t current = tilt_permille(45);
+
+    // The pulses end on their deadline to the microsecond, even those of a single step of the slats.
+    for (size_t i = 0; i < sizeof(angles) / sizeof(angles[0]); i++)
+    {
+        int16_t target = tilt_permille(angles[i]);
+        int64_t duration = (target > current ? target - current : current - target) * step_us;
+
+        int64_t start = tilt(angles[i]);
+        sim_advance(SIM_RELAY_DELAY_US + duration + SETTLE_US);
+
+        const sim_edge_t *enable = motor_edge(0, start, true);
+        SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+        SIM_CHECK(gpio_get_level(sim_channels[0].motor_direction) == sim_direction_level(0, CHANNEL_EVENT_STOP));
+
+        const sim_edge_t *disable = motor_edge(0, enable->time, false);
+        SIM_CHECK(disable != NULL && disable->time == enable->time + duration);
+        SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+
+        SIM_CHECK(controller_query_tilt(0) == angles[i]);
+        current = target;
+    }
+
+    // The slats already are at the angle, so there is nothing to pulse.
+    int64_t start = tilt(30);
+    sim_advance(SETTLE_US);
+    SIM_CHECK(motor_edge(0, start, true) == NULL);
+}
+
+static void test_retarget()
+{
+    int64_t step_us = sim_channels[0].tilt_time_ms;
+
+    // A new angle the same way while pulsing only moves the end of the running pulse.
+    int64_t start = tilt(90);
+    sim_advance(SIM_RELAY_DELAY_US + 200 * step_us);
+
+    int64_t retarget = esp_timer_get_time();
+    SIM_CHECK(controller_tilt(0, 60, true) == ESP_OK);
+    sim_settle();
+    sim_advance((tilt_permille(60) - tilt_permille(30) - 200) * step_us + SETTLE_US);
+
+    const sim_edge_t *enable = motor_edge(0, start, true);
+    SIM_CHECK(enable != NULL && enable->time == start + SIM_RELAY_DELAY_US);
+
+    const sim_edge_t *disable = motor_edge(0, enable->time, false);
+    SIM_CHECK(disable != NULL && disable->time == retarget + (tilt_permille(60) - tilt_permille(30) - 200) * step_us);
+    SIM_CHECK(motor_edge(0, disable->time, true) == NULL);
+    SIM_CHECK(controller_query_tilt(0) == 60);
+
+    // A stop cuts the pulse right away and keeps the angle turned so far.
+    start = tilt(0);
+    sim_advance(SIM_RELAY_DELAY_US + (tilt_permille(60) - tilt_permille(30)) * step_us);
+
+    int64_t stop = esp_timer_get_time();
+    SIM_CHECK(controller_stop(0, true) == ESP_OK);
+    sim_settle();
+    sim_advance(SETTLE_US);
+
+    disable = motor_edge(0, start, false);
+    SIM_CHECK(disable != NULL && disable->time == stop);
+    SIM_CHECK(controller_query_tilt(0) == 30);
+}
+
+int main()
+{
+    sim_start();
+
+    test_homing();
+    test_pulses();
+    test_retarget();
+
+    printf("Simulated %.1f s.\n", (esp_timer_get_time() - SIM_START_TIME_US) / 1e6);
+    return 0;
+}
@@ -5,3 +5,6 @@
 extern const httpd_uri_t actions_open_uri_handler;
 extern const httpd_uri_t actions_close_uri_handler;
 extern const httpd_uri_t actions_stop_uri_handler;
+extern const httpd_uri_t actions_position_uri_handler;
+extern const httpd_uri_t actions_tilt_uri_handler;
+extern const httpd_uri_t actions_batch_uri_handler;
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+extern const httpd_uri_t events_uri_handler;
+
+void events_init();
+void events_stop();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+#define JSON_BUFFER_SIZE 256
+#define JSON_MAX_DEPTH 8
+
+typedef struct json_writer
+{
+    httpd_req_t *req;
+    esp_err_t err;
+
+    char buffer[JSON_BUFFER_SIZE];
+    size_t length;
+
+    uint8_t depth;
+    bool has_value[JSON_MAX_DEPTH];
+    bool after_key;
+} json_writer_t;
+
+void json_begin(json_writer_t *writer, httpd_req_t *req);
+esp_err_t json_end(json_writer_t *writer);
+
+void json_object_begin(json_writer_t *writer);
+void json_object_end(json_writer_t *writer);
+void json_array_begin(json_writer_t *writer);
+void json_array_end(json_writer_t *writer);
+
+void json_key(json_writer_t *writer, const char *key);
+void json_int(json_writer_t *writer, int64_t value);
+void json_bool(json_writer_t *writer, bool value);
+void json_null(json_writer_t *writer);
+void json_string(json_writer_t *writer, const char *value);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+extern const httpd_uri_t metrics_uri_handler;
+extern const httpd_uri_t trace_uri_handler;
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+void session_start(httpd_handle_t server);
+void session_stop();
+
+typedef void session_close_func(void *arg);
+
+esp_err_t session_track(httpd_req_t *req);
+esp_err_t session_hold(httpd_req_t *req, session_close_func *on_close, void *arg);
+
+// Hands the socket of the request over to the caller, which has to close it after on_release was called.
+esp_err_t session_detach(httpd_req_t *req, session_close_func *on_release, void *arg);
+esp_err_t session_open(httpd_handle_t server, int fd);
+void session_close(httpd_handle_t server, int fd);
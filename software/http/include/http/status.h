@@ -3,3 +3,5 @@
 #include "esp_http_server.h"
 
 extern const httpd_uri_t status_uri_handler;
+extern const httpd_uri_t status_queue_uri_handler;
+extern const httpd_uri_t status_boot_uri_handler;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+extern const httpd_uri_t tail_uri_handler;
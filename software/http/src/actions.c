@@ -1,4 +1,6 @@
 #include "http/actions.h"
+#include "http/session.h"
+#include "http/json.h"
 
 #include "config.h"
 #include "controller.h"
@@ -6,14 +8,40 @@
 #include "esp_log.h"
 #include "esp_http_server.h"
 
+#include <string.h>
+
 static const char *const TAG = "HTTP       : Actions  ";
 
+static const char *const ACTION_NAMES[] = {
+    [CHANNEL_EVENT_OPEN] = "open",
+    [CHANNEL_EVENT_CLOSE] = "close",
+    [CHANNEL_EVENT_STOP] = "stop",
+    [CHANNEL_EVENT_POSITION] = "position",
+    [CHANNEL_EVENT_TILT] = "tilt",
+};
+
+typedef struct batch_command
+{
+    uint8_t channel;
+    channel_event_t event;
+    uint8_t value;
+} batch_command_t;
+
 static esp_err_t post_open_handler(httpd_req_t *);
 static esp_err_t post_close_handler(httpd_req_t *);
 static esp_err_t post_stop_handler(httpd_req_t *);
+static esp_err_t post_position_handler(httpd_req_t *);
+static esp_err_t post_tilt_handler(httpd_req_t *);
+static esp_err_t post_batch_handler(httpd_req_t *);
+
+static esp_err_t dispatch(httpd_req_t *, const char *, channel_event_t, uint8_t);
 
+static esp_err_t parse_batch(httpd_req_t *, batch_command_t *, uint8_t *);
+static esp_err_t parse_command(const char *, batch_command_t *);
 static esp_err_t parse_channel(const char *, uint8_t *);
-static esp_err_t redirect_to_index(httpd_req_t *);
+static esp_err_t parse_group(httpd_req_t *, uint32_t *);
+static esp_err_t parse_value(httpd_req_t *, const char *, uint8_t, uint8_t *);
+static esp_err_t redirect_to_index(httpd_req_t *, const char *);
 
 const httpd_uri_t actions_open_uri_handler = {
     .uri = CONFIG_ACTIONS_OPEN_URI "/?*",
@@ -36,64 +64,299 @@ const httpd_uri_t actions_stop_uri_handler = {
     .user_ctx = NULL,
 };
 
+const httpd_uri_t actions_position_uri_handler = {
+    .uri = CONFIG_ACTIONS_POSITION_URI "/?*",
+    .method = HTTP_POST,
+    .handler = &post_position_handler,
+    .user_ctx = NULL,
+};
+
+const httpd_uri_t actions_tilt_uri_handler = {
+    .uri = CONFIG_ACTIONS_TILT_URI "/?*",
+    .method = HTTP_POST,
+    .handler = &post_tilt_handler,
+    .user_ctx = NULL,
+};
+
+const httpd_uri_t actions_batch_uri_handler = {
+    .uri = CONFIG_ACTIONS_BATCH_URI,
+    .method = HTTP_POST,
+    .handler = &post_batch_handler,
+    .user_ctx = NULL,
+};
+
 static esp_err_t post_open_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
 
-    if (!strcmp(req->uri, CONFIG_ACTIONS_OPEN_URI) || !strcmp(req->uri, CONFIG_ACTIONS_OPEN_URI "/"))
-    {
-        controller_open_all(true);
-        return redirect_to_index(req);
-    }
+    return dispatch(req, CONFIG_ACTIONS_OPEN_URI, CHANNEL_EVENT_OPEN, 0);
+}
 
-    uint8_t channel;
+static esp_err_t post_close_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    return dispatch(req, CONFIG_ACTIONS_CLOSE_URI, CHANNEL_EVENT_CLOSE, 0);
+}
 
-    esp_err_t err = parse_channel(req->uri + strlen(CONFIG_ACTIONS_OPEN_URI "/"), &channel);
+static esp_err_t post_stop_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    return dispatch(req, CONFIG_ACTIONS_STOP_URI, CHANNEL_EVENT_STOP, 0);
+}
+
+static esp_err_t post_position_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    uint8_t position;
+
+    esp_err_t err = parse_value(req, "pct", 100, &position);
     if (err != ESP_OK)
         return err;
 
-    controller_open(channel, true);
-    return redirect_to_index(req);
+    return dispatch(req, CONFIG_ACTIONS_POSITION_URI, CHANNEL_EVENT_POSITION, position);
 }
 
-static esp_err_t post_close_handler(httpd_req_t *req)
+static esp_err_t post_tilt_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
 
-    if (!strcmp(req->uri, CONFIG_ACTIONS_CLOSE_URI) || !strcmp(req->uri, CONFIG_ACTIONS_CLOSE_URI "/"))
+    uint8_t angle;
+
+    esp_err_t err = parse_value(req, "angle", CHANNEL_TILT_MAX_ANGLE, &angle);
+    if (err != ESP_OK)
+        return err;
+
+    return dispatch(req, CONFIG_ACTIONS_TILT_URI, CHANNEL_EVENT_TILT, angle);
+}
+
+static esp_err_t post_batch_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    batch_command_t commands[CONFIG_ACTIONS_BATCH_MAX];
+    uint32_t accepted[CONFIG_ACTIONS_BATCH_MAX];
+    uint8_t dispatches[CONFIG_ACTIONS_BATCH_MAX];
+    uint8_t count;
+
+    esp_err_t err = parse_batch(req, commands, &count);
+    if (err != ESP_OK)
+        return err;
+
+    memset(dispatches, UINT8_MAX, sizeof(dispatches));
+
+    // Commands with the same action are dispatched together, so group staggering applies across them. A command
+    // is only moved forward past commands for other channels, every channel gets its commands in request order.
+    for (uint8_t i = 0; i < count; i++)
     {
-        controller_close_all(true);
-        return redirect_to_index(req);
-    }
+        if (dispatches[i] != UINT8_MAX)
+            continue;
 
-    uint8_t channel;
+        uint32_t channel_mask = 0;
+        uint32_t blocked_mask = 0;
+
+        for (uint8_t j = i; j < count; j++)
+        {
+            if (dispatches[j] != UINT8_MAX)
+                continue;
+
+            uint32_t mask = CONTROLLER_CHANNEL_MASK(commands[j].channel);
+
+            if (commands[j].event == commands[i].event && commands[j].value == commands[i].value && !(blocked_mask & mask))
+            {
+                dispatches[j] = i;
+                channel_mask |= mask;
+            }
+            else
+            {
+                blocked_mask |= mask;
+            }
+        }
 
-    esp_err_t err = parse_channel(req->uri + strlen(CONFIG_ACTIONS_CLOSE_URI "/"), &channel);
+        if (controller_dispatch(channel_mask, commands[i].event, commands[i].value, true, &accepted[i]) != ESP_OK)
+            ESP_LOGW(TAG, "Batch command %s rejected for some channels.", ACTION_NAMES[commands[i].event]);
+    }
+
+    err = session_track(req);
     if (err != ESP_OK)
         return err;
 
-    controller_close(channel, true);
-    return redirect_to_index(req);
+    json_writer_t writer;
+    json_begin(&writer, req);
+    json_array_begin(&writer);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t channel_accepted = accepted[dispatches[i]];
+
+        json_object_begin(&writer);
+        json_key(&writer, "channel");
+        json_int(&writer, commands[i].channel);
+        json_key(&writer, "action");
+        json_string(&writer, ACTION_NAMES[commands[i].event]);
+        json_key(&writer, "accepted");
+        json_bool(&writer, channel_accepted & CONTROLLER_CHANNEL_MASK(commands[i].channel));
+        json_object_end(&writer);
+    }
+
+    json_array_end(&writer);
+    return json_end(&writer);
 }
 
-static esp_err_t post_stop_handler(httpd_req_t *req)
+static esp_err_t dispatch(httpd_req_t *req, const char *base_uri, channel_event_t event, uint8_t value)
 {
-    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+    const char *path = req->uri + strlen(base_uri);
+    if (*path == '/')
+        path++;
+
+    uint32_t channel_mask;
+    esp_err_t err;
 
-    if (!strcmp(req->uri, CONFIG_ACTIONS_STOP_URI) || !strcmp(req->uri, CONFIG_ACTIONS_STOP_URI "/"))
+    // Without a channel number the action applies to all channels or the selected group.
+    if (!*path || *path == '?')
     {
-        controller_stop_all(true);
-        return redirect_to_index(req);
+        err = parse_group(req, &channel_mask);
     }
+    else
+    {
+        uint8_t channel;
 
-    uint8_t channel;
+        err = parse_channel(path, &channel);
+        channel_mask = CONTROLLER_CHANNEL_MASK(channel);
+    }
 
-    esp_err_t err = parse_channel(req->uri + strlen(CONFIG_ACTIONS_STOP_URI "/"), &channel);
     if (err != ESP_OK)
         return err;
 
-    controller_stop(channel, true);
-    return redirect_to_index(req);
+    uint32_t accepted;
+    err = controller_dispatch(channel_mask, event, value, true, &accepted);
+
+    char accepted_str[12];
+    snprintf(accepted_str, sizeof(accepted_str), "0x%02" PRIx32, accepted);
+
+    if (err == ESP_OK)
+        return redirect_to_index(req, accepted_str);
+
+    ESP_LOGW(TAG, "Command rejected. (%s)", esp_err_to_name(err));
+
+    err = httpd_resp_set_status(req, "503 Service Unavailable");
+    if (err != ESP_OK)
+        return err;
+
+    err = httpd_resp_set_hdr(req, "X-Accepted-Channels", accepted_str);
+    if (err != ESP_OK)
+        return err;
+
+    err = session_track(req);
+    if (err != ESP_OK)
+        return err;
+
+    return httpd_resp_sendstr(req, "Command rejected by controller.");
+}
+
+static esp_err_t parse_batch(httpd_req_t *req, batch_command_t *commands, uint8_t *count_out)
+{
+    char chunk[64];
+    char pair[24];
+    size_t pair_length = 0;
+    size_t remaining = req->content_len;
+    uint8_t count = 0;
+
+    // The body is tokenized chunk by chunk, only the pair being parsed is kept.
+    while (remaining > 0 || pair_length > 0)
+    {
+        int32_t received = 0;
+
+        if (remaining > 0)
+        {
+            received = httpd_req_recv(req, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+            if (received <= 0)
+                return ESP_FAIL;
+
+            remaining -= received;
+        }
+
+        for (int32_t i = 0; i <= received; i++)
+        {
+            // The end of the body terminates the last pair.
+            bool end = i == received;
+            if (end && remaining > 0)
+                break;
+
+            char c = end ? '&' : chunk[i];
+
+            if (c != '&' && c != ',' && c != ';' && c != '\n' && c != '\r' && c != ' ')
+            {
+                if (pair_length >= sizeof(pair) - 1)
+                    return ESP_ERR_INVALID_ARG;
+
+                pair[pair_length++] = c;
+                continue;
+            }
+
+            if (pair_length == 0)
+                continue;
+
+            if (count >= CONFIG_ACTIONS_BATCH_MAX)
+                return ESP_ERR_INVALID_SIZE;
+
+            pair[pair_length] = '\0';
+            pair_length = 0;
+
+            esp_err_t err = parse_command(pair, &commands[count++]);
+            if (err != ESP_OK)
+                return err;
+        }
+    }
+
+    if (count == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    *count_out = count;
+    return ESP_OK;
+}
+
+static esp_err_t parse_command(const char *str, batch_command_t *command)
+{
+    // A command is written as <channel_num>=<action>[:<value>], e.g. 3=close or 5=position:40.
+    char *end;
+    uint64_t channel = strtoul(str, &end, 10);
+
+    if (channel >= CONFIG_CONTROLLER_CHANNEL_NUM || end == str || *end != '=')
+        return ESP_ERR_INVALID_ARG;
+
+    const char *action = end + 1;
+    const char *separator = strchr(action, ':');
+    size_t action_length = separator ? (size_t)(separator - action) : strlen(action);
+
+    command->channel = (uint8_t)channel;
+    command->value = 0;
+
+    for (uint8_t event = 0; event < sizeof(ACTION_NAMES) / sizeof(ACTION_NAMES[0]); event++)
+    {
+        if (strlen(ACTION_NAMES[event]) != action_length || strncmp(ACTION_NAMES[event], action, action_length))
+            continue;
+
+        command->event = event;
+
+        uint8_t max = event == CHANNEL_EVENT_POSITION ? 100 : event == CHANNEL_EVENT_TILT ? CHANNEL_TILT_MAX_ANGLE : 0;
+        if (max == 0)
+            return separator ? ESP_ERR_INVALID_ARG : ESP_OK;
+
+        if (!separator)
+            return ESP_ERR_INVALID_ARG;
+
+        uint64_t number = strtoul(separator + 1, &end, 10);
+        if (number > max || end == separator + 1 || *end)
+            return ESP_ERR_INVALID_ARG;
+
+        command->value = (uint8_t)number;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_INVALID_ARG;
 }
 
 static esp_err_t parse_channel(const char *str, uint8_t *channel_out)
@@ -101,24 +364,87 @@ static esp_err_t parse_channel(const char *str, uint8_t *channel_out)
     char *end;
     uint64_t channel = strtoul(str, &end, 10);
 
-    if (channel > 255 || end == str || *end)
+    if (channel >= CONFIG_CONTROLLER_CHANNEL_NUM || end == str || (*end && *end != '?'))
         return ESP_ERR_INVALID_ARG;
 
     *channel_out = (uint8_t)channel;
     return ESP_OK;
 }
 
-static esp_err_t redirect_to_index(httpd_req_t *req)
+static esp_err_t parse_group(httpd_req_t *req, uint32_t *channel_mask_out)
+{
+    char params[64];
+    char value[24];
+
+    *channel_mask_out = CONTROLLER_ALL_CHANNELS;
+
+    if (httpd_req_get_url_query_str(req, params, sizeof(params)) != ESP_OK)
+        return ESP_OK;
+
+    if (httpd_query_key_value(params, "group", value, sizeof(value)) == ESP_OK)
+        return controller_find_group(value, channel_mask_out);
+
+    if (httpd_query_key_value(params, "channels", value, sizeof(value)) != ESP_OK)
+        return ESP_OK;
+
+    char *end;
+    uint64_t channel_mask = strtoul(value, &end, 0);
+
+    if (channel_mask > CONTROLLER_ALL_CHANNELS || end == value || *end)
+        return ESP_ERR_INVALID_ARG;
+
+    *channel_mask_out = (uint32_t)channel_mask;
+    return ESP_OK;
+}
+
+static esp_err_t parse_value(httpd_req_t *req, const char *key, uint8_t max, uint8_t *value_out)
+{
+    char params[64];
+    char value[8];
+
+    // Values are accepted as query parameter as well as form data from the web interface.
+    if (httpd_req_get_url_query_str(req, params, sizeof(params)) != ESP_OK ||
+        httpd_query_key_value(params, key, value, sizeof(value)) != ESP_OK)
+    {
+        if (req->content_len == 0 || req->content_len >= sizeof(params))
+            return ESP_ERR_INVALID_ARG;
+
+        int32_t received = httpd_req_recv(req, params, req->content_len);
+        if (received <= 0)
+            return ESP_FAIL;
+
+        params[received] = '\0';
+
+        esp_err_t err = httpd_query_key_value(params, key, value, sizeof(value));
+        if (err != ESP_OK)
+            return err;
+    }
+
+    char *end;
+    uint64_t number = strtoul(value, &end, 10);
+
+    if (number > max || end == value || *end)
+        return ESP_ERR_INVALID_ARG;
+
+    *value_out = (uint8_t)number;
+    return ESP_OK;
+}
+
+static esp_err_t redirect_to_index(httpd_req_t *req, const char *accepted)
 {
     esp_err_t err = httpd_resp_set_status(req, "303 See Other");
     if (err != ESP_OK)
         return err;
 
+    err = httpd_resp_set_hdr(req, "X-Accepted-Channels", accepted);
+    if (err != ESP_OK)
+        return err;
+
     err = httpd_resp_set_hdr(req, "Location", "/");
     if (err != ESP_OK)
         return err;
 
-    err = httpd_resp_set_hdr(req, "Connection", "close");
+    err = session_track(req);
     if (err != ESP_OK)
         return err;
 
@@ -0,0 +1,322 @@
+#include "http/events.h"
+#include "http/session.h"
+
+#include "config.h"
+#include "controller.h"
+
+#include "esp_log.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *const TAG = "HTTP       : Events   ";
+
+static const char *const EVENTS_HEADER =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "retry: 3000\n\n";
+
+static const char *const EVENT_NAMES[] = {
+    [CONTROLLER_EVENT_STARTED] = "started",
+    [CONTROLLER_EVENT_STOPPED] = "stopped",
+    [CONTROLLER_EVENT_REVERSING] = "reversing",
+    [CONTROLLER_EVENT_TIMEOUT] = "timeout",
+};
+
+typedef struct event_record
+{
+    controller_event_t event;
+    controller_event_data_t data;
+} event_record_t;
+
+// Records leave the ring when formatted into the pending buffer, which keeps the part the socket did not take yet, or
+// when a newer record needs their place.
+typedef struct subscriber
+{
+    bool active;
+    int fd;
+    uint16_t dropped;
+    uint8_t head;
+    uint8_t count;
+    event_record_t events[CONFIG_EVENTS_BUFFER_SIZE];
+    char pending[160];
+    uint8_t pending_offset;
+    uint8_t pending_length;
+} subscriber_t;
+
+_Static_assert(CONFIG_EVENTS_BUFFER_SIZE <= UINT8_MAX, "CONFIG_EVENTS_BUFFER_SIZE must fit into uint8_t.");
+
+static subscriber_t subscribers[CONFIG_EVENTS_MAX_SUBSCRIBERS];
+static portMUX_TYPE subscribers_lock = portMUX_INITIALIZER_UNLOCKED;
+static httpd_handle_t events_server = NULL;
+static esp_timer_handle_t retry_timer = NULL;
+static bool flush_pending = false;
+
+static esp_err_t get_events_handler(httpd_req_t *);
+
+static void events_controller_handler(void *, esp_event_base_t, int32_t, void *);
+static void events_retry_handler(void *);
+static void events_release(void *);
+static void events_schedule_flush();
+static void events_flush(void *);
+static void events_format(subscriber_t *, const event_record_t *, uint16_t);
+static bool events_send(httpd_handle_t, subscriber_t *);
+
+const httpd_uri_t events_uri_handler = {
+    .uri = CONFIG_EVENTS_URI,
+    .method = HTTP_GET,
+    .handler = &get_events_handler,
+    .user_ctx = NULL,
+};
+
+void events_init()
+{
+    esp_timer_create_args_t retry_timer_config = {
+        .callback = &events_retry_handler,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "events_retry",
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&retry_timer_config, &retry_timer));
+    ESP_ERROR_CHECK(controller_register_event_handler(&events_controller_handler, NULL));
+}
+
+void events_stop()
+{
+    // Subscribers are released by the server when it closes their sockets, only the flushes have to end here.
+    portENTER_CRITICAL(&subscribers_lock);
+    events_server = NULL;
+    flush_pending = false;
+    esp_timer_stop(retry_timer);
+    portEXIT_CRITICAL(&subscribers_lock);
+}
+
+static esp_err_t get_events_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    esp_err_t err = session_track(req);
+    if (err != ESP_OK)
+        return err;
+
+    subscriber_t *subscriber = NULL;
+    int fd = httpd_req_to_sockfd(req);
+    size_t header_length = strlen(EVENTS_HEADER);
+
+    _Static_assert(sizeof(subscriber->pending) <= UINT8_MAX, "Pending buffer must be indexable with uint8_t.");
+
+    portENTER_CRITICAL(&subscribers_lock);
+    events_server = req->handle;
+    for (uint8_t i = 0; i < CONFIG_EVENTS_MAX_SUBSCRIBERS && subscriber == NULL; i++)
+    {
+        if (subscribers[i].active)
+            continue;
+
+        subscriber = &subscribers[i];
+        *subscriber = (subscriber_t){.active = true, .fd = fd, .pending_length = header_length};
+        memcpy(subscriber->pending, EVENTS_HEADER, header_length);
+    }
+    portEXIT_CRITICAL(&subscribers_lock);
+
+    if (subscriber == NULL)
+    {
+        ESP_LOGW(TAG, "No free subscriber slot.");
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // The stream is written directly to the socket, the server never sends a response for it.
+    if (session_hold(req, &events_release, subscriber) != ESP_OK)
+    {
+        events_release(subscriber);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Subscriber %d connected.", fd);
+
+    // The header is sent like the events, so a client that does not read cannot block the server task.
+    events_schedule_flush();
+    return ESP_OK;
+}
+
+static void events_controller_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    event_record_t record = {
+        .event = id,
+        .data = *(const controller_event_data_t *)data,
+    };
+
+    bool is_subscribed = false;
+
+    portENTER_CRITICAL(&subscribers_lock);
+    for (uint8_t i = 0; i < CONFIG_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        subscriber_t *subscriber = &subscribers[i];
+
+        if (!subscriber->active)
+            continue;
+
+        // A subscriber that cannot keep up loses its oldest events, it is told how many with the next flush.
+        if (subscriber->count == CONFIG_EVENTS_BUFFER_SIZE)
+        {
+            subscriber->head = (subscriber->head + 1) % CONFIG_EVENTS_BUFFER_SIZE;
+            subscriber->count--;
+            if (subscriber->dropped < UINT16_MAX)
+                subscriber->dropped++;
+        }
+
+        subscriber->events[(subscriber->head + subscriber->count) % CONFIG_EVENTS_BUFFER_SIZE] = record;
+        subscriber->count++;
+        is_subscribed = true;
+    }
+    portEXIT_CRITICAL(&subscribers_lock);
+
+    if (is_subscribed)
+        events_schedule_flush();
+}
+
+static void events_retry_handler(void *arg)
+{
+    events_schedule_flush();
+}
+
+static void events_release(void *arg)
+{
+    subscriber_t *subscriber = arg;
+
+    portENTER_CRITICAL(&subscribers_lock);
+    subscriber->active = false;
+    portEXIT_CRITICAL(&subscribers_lock);
+
+    ESP_LOGI(TAG, "Subscriber %d disconnected.", subscriber->fd);
+}
+
+static void events_schedule_flush()
+{
+    portENTER_CRITICAL(&subscribers_lock);
+    httpd_handle_t server = events_server;
+    bool flush = server != NULL && !flush_pending;
+    if (flush)
+        flush_pending = true;
+    portEXIT_CRITICAL(&subscribers_lock);
+
+    if (!flush)
+        return;
+
+    // Sessions may only be written from within the server task.
+    if (httpd_queue_work(server, &events_flush, NULL) != ESP_OK)
+    {
+        portENTER_CRITICAL(&subscribers_lock);
+        flush_pending = false;
+        portEXIT_CRITICAL(&subscribers_lock);
+    }
+}
+
+static void events_flush(void *arg)
+{
+    bool is_blocked = false;
+
+    // A flush queued before events_stop may still run until the server task ended, it must not see the cleared handle.
+    portENTER_CRITICAL(&subscribers_lock);
+    httpd_handle_t server = events_server;
+    flush_pending = false;
+    portEXIT_CRITICAL(&subscribers_lock);
+
+    if (server == NULL)
+        return;
+
+    for (uint8_t i = 0; i < CONFIG_EVENTS_MAX_SUBSCRIBERS; i++)
+    {
+        subscriber_t *subscriber = &subscribers[i];
+
+        while (true)
+        {
+            portENTER_CRITICAL(&subscribers_lock);
+            bool is_active = subscriber->active;
+            bool is_idle = subscriber->pending_offset == subscriber->pending_length;
+            uint16_t dropped = is_idle ? subscriber->dropped : 0;
+            bool has_record = is_idle && dropped == 0 && subscriber->count > 0;
+            event_record_t record = subscriber->events[subscriber->head];
+
+            if (is_active && dropped > 0)
+                subscriber->dropped = 0;
+
+            if (is_active && has_record)
+            {
+                subscriber->head = (subscriber->head + 1) % CONFIG_EVENTS_BUFFER_SIZE;
+                subscriber->count--;
+            }
+            portEXIT_CRITICAL(&subscribers_lock);
+
+            if (!is_active)
+                break;
+
+            if (dropped > 0)
+                ESP_LOGW(TAG, "Subscriber %d fell behind, dropped %u events.", subscriber->fd, dropped);
+
+            if (dropped > 0 || has_record)
+                events_format(subscriber, &record, dropped);
+
+            if (subscriber->pending_offset == subscriber->pending_length)
+                break;
+
+            if (!events_send(server, subscriber))
+            {
+                ESP_LOGW(TAG, "Subscriber %d unreachable, closing.", subscriber->fd);
+                httpd_sess_trigger_close(server, subscriber->fd);
+                break;
+            }
+
+            // The socket buffer is full, the rest stays pending until the next flush.
+            if (subscriber->pending_offset < subscriber->pending_length)
+            {
+                is_blocked = true;
+                break;
+            }
+        }
+    }
+
+    // New events trigger a flush by themselves, blocked subscribers without new events need a retry.
+    if (is_blocked)
+        esp_timer_start_once(retry_timer, CONFIG_EVENTS_RETRY_MS * 1000);
+}
+
+static void events_format(subscriber_t *subscriber, const event_record_t *record, uint16_t dropped)
+{
+    subscriber->pending_offset = 0;
+
+    // The loss is reported before the events that follow it, so clients know to query /status again.
+    if (dropped > 0)
+        subscriber->pending_length = snprintf(subscriber->pending, sizeof(subscriber->pending),
+                                              "event: dropped\ndata: {\"count\":%u}\n\n", dropped);
+    else
+        subscriber->pending_length = snprintf(subscriber->pending, sizeof(subscriber->pending),
+                                              "event: %s\ndata: {\"channel\":%u,\"direction\":%d,\"time_ms\":%" PRId64 "}\n\n",
+                                              EVENT_NAMES[record->event], record->data.channel_num, record->data.direction, record->data.timestamp / 1000);
+}
+
+static bool events_send(httpd_handle_t server, subscriber_t *subscriber)
+{
+    // Never waits for the client, a slow subscriber would stall every other request of the server task otherwise.
+    while (subscriber->pending_offset < subscriber->pending_length)
+    {
+        int sent = httpd_socket_send(server, subscriber->fd, subscriber->pending + subscriber->pending_offset,
+                                     subscriber->pending_length - subscriber->pending_offset, MSG_DONTWAIT);
+        if (sent == HTTPD_SOCK_ERR_TIMEOUT)
+            return true;
+
+        if (sent <= 0)
+            return false;
+
+        subscriber->pending_offset += sent;
+    }
+
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "http/flash.h"
+#include "http/session.h"
 
 #include "config.h"
 #include "update.h"
@@ -7,11 +8,46 @@
 #include "esp_http_server.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+
+#include <stdio.h>
+#include <string.h>
 
 static const char *const TAG = "HTTP       : Flash     ";
 
+typedef struct flash_chunk
+{
+    uint8_t index;
+    size_t length;
+} flash_chunk_t;
+
+typedef struct flash_pipeline
+{
+    int fd;
+    char *buffers[2];
+    size_t first_length;
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    SemaphoreHandle_t released;
+    TaskHandle_t receiver;
+    size_t image_size;
+    volatile bool write_failed;
+} flash_pipeline_t;
+
 static esp_err_t post_flash_handler(httpd_req_t *);
 
+static flash_pipeline_t *flash_pipeline_create(size_t);
+static void flash_pipeline_free(flash_pipeline_t *);
+static void flash_release(void *);
+
+static void flash_receive_task(void *);
+static bool flash_receive(flash_pipeline_t *);
+static bool flash_receive_chunk(int, char *, size_t);
+static void flash_respond(int, const char *, const char *);
+static void flash_write_task(void *);
+
 const httpd_uri_t flash_uri_handler = {
     .uri = CONFIG_FLASH_URI "/?*",
     .method = HTTP_POST,
@@ -26,8 +62,8 @@ static esp_err_t post_flash_handler(httpd_req_t *req)
     httpd_resp_set_hdr(req, "Connection", "close");
     httpd_resp_set_status(req, HTTPD_500);
 
-    size_t remaining = req->content_len;
-    switch (update_prepare(remaining))
+    size_t image_size = req->content_len;
+    switch (update_prepare(image_size))
     {
     case UPDATE_ERR_IMAGE_TOO_LARGE:;
         char msg[64];
@@ -48,51 +84,252 @@ static esp_err_t post_flash_handler(httpd_req_t *req)
         break;
     }
 
-    char *buffer = malloc(CONFIG_FLASH_BUFFER_SIZE);
-    while (remaining > 0)
+    flash_pipeline_t *pipeline = flash_pipeline_create(image_size);
+    if (pipeline == NULL)
     {
-        int32_t received = httpd_req_recv(req, buffer, CONFIG_FLASH_BUFFER_SIZE);
+        ESP_LOGE(TAG, "Failed to set up upload pipeline.");
+        update_abort();
+        httpd_resp_sendstr(req, "Cannot start firmware update.");
+        return ESP_FAIL;
+    }
 
-        if (received == HTTPD_SOCK_ERR_TIMEOUT)
-            continue;
+    // Body bytes the server read along with the headers are only available through the request.
+    int received = httpd_req_recv(req, pipeline->buffers[0], image_size < CONFIG_FLASH_BUFFER_SIZE ? image_size : CONFIG_FLASH_BUFFER_SIZE);
+    if (received <= 0 || session_track(req) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Image upload failed.");
+        update_abort();
+        flash_pipeline_free(pipeline);
+        httpd_resp_sendstr(req, "Image upload failed. Try again!");
+        return ESP_FAIL;
+    }
 
-        if (received <= 0)
-        {
-            ESP_LOGE(TAG, "Image upload failed.");
-            update_abort();
+    pipeline->first_length = received;
+    pipeline->fd = httpd_req_to_sockfd(req);
 
-            httpd_resp_sendstr(req, "Image upload failed. Try again!");
-            return ESP_FAIL;
-        }
+    // The rest is received on a task of its own with the socket taken from the server, which keeps serving
+    // the other endpoints during the upload.
+    esp_err_t err = session_detach(req, &flash_release, pipeline);
+    if (err != ESP_OK)
+    {
+        update_abort();
+        flash_pipeline_free(pipeline);
+        httpd_resp_sendstr(req, "Cannot start firmware update.");
+        return err;
+    }
+
+    if (xTaskCreate(&flash_receive_task, "flash_receive", CONFIG_FLASH_TASK_STACK_SIZE, pipeline, CONFIG_FLASH_TASK_PRIORITY, &pipeline->receiver) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create receive task.");
+        pipeline->receiver = NULL;
+        update_abort();
+        flash_respond(pipeline->fd, HTTPD_500, "Cannot start firmware update.");
+    }
+
+    return ESP_OK;
+}
+
+static flash_pipeline_t *flash_pipeline_create(size_t image_size)
+{
+    flash_pipeline_t *pipeline = calloc(1, sizeof(flash_pipeline_t));
+    if (pipeline == NULL)
+        return NULL;
+
+    // One buffer is filled from the network while the other one is written to flash.
+    pipeline->buffers[0] = malloc(CONFIG_FLASH_BUFFER_SIZE);
+    pipeline->buffers[1] = malloc(CONFIG_FLASH_BUFFER_SIZE);
+    pipeline->free_queue = xQueueCreate(2, sizeof(uint8_t));
+    pipeline->full_queue = xQueueCreate(2, sizeof(flash_chunk_t));
+    pipeline->released = xSemaphoreCreateBinary();
+    pipeline->image_size = image_size;
+    pipeline->fd = -1;
+
+    if (pipeline->buffers[0] == NULL || pipeline->buffers[1] == NULL || pipeline->free_queue == NULL || pipeline->full_queue == NULL || pipeline->released == NULL)
+    {
+        flash_pipeline_free(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+static void flash_pipeline_free(flash_pipeline_t *pipeline)
+{
+    free(pipeline->buffers[0]);
+    free(pipeline->buffers[1]);
+    if (pipeline->free_queue != NULL)
+        vQueueDelete(pipeline->free_queue);
+    if (pipeline->full_queue != NULL)
+        vQueueDelete(pipeline->full_queue);
+    if (pipeline->released != NULL)
+        vSemaphoreDelete(pipeline->released);
+
+    free(pipeline);
+}
+
+static void flash_release(void *arg)
+{
+    flash_pipeline_t *pipeline = arg;
+
+    // Called by the server once it dropped the session. Without a receive task nobody else closes the socket.
+    if (pipeline->receiver == NULL)
+    {
+        close(pipeline->fd);
+        flash_pipeline_free(pipeline);
+        return;
+    }
+
+    xSemaphoreGive(pipeline->released);
+}
+
+static void flash_receive_task(void *arg)
+{
+    flash_pipeline_t *pipeline = arg;
+
+    bool succeeded = flash_receive(pipeline);
 
-        if (update_write(buffer, received, &remaining) == UPDATE_FAILED)
+    // The server may still be about to drop the session, the socket is only closed after it let go of it.
+    xSemaphoreTake(pipeline->released, portMAX_DELAY);
+    close(pipeline->fd);
+    flash_pipeline_free(pipeline);
+
+    if (succeeded)
+        update_reboot();
+
+    vTaskDelete(NULL);
+}
+
+static bool flash_receive(flash_pipeline_t *pipeline)
+{
+    if (xTaskCreate(&flash_write_task, "flash_write", CONFIG_FLASH_TASK_STACK_SIZE, pipeline, CONFIG_FLASH_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create write task.");
+        update_abort();
+        flash_respond(pipeline->fd, HTTPD_500, "Cannot start firmware update.");
+        return false;
+    }
+
+    for (uint8_t index = 0; index < 2; index++)
+        xQueueSend(pipeline->free_queue, &index, 0);
+
+    size_t remaining = pipeline->image_size;
+    size_t filled = pipeline->first_length;
+    bool upload_failed = false;
+
+    // The first buffer handed out is the one already holding the start of the body.
+    while (remaining > 0 && !pipeline->write_failed)
+    {
+        flash_chunk_t chunk = {.length = remaining < CONFIG_FLASH_BUFFER_SIZE ? remaining : CONFIG_FLASH_BUFFER_SIZE};
+        xQueueReceive(pipeline->free_queue, &chunk.index, portMAX_DELAY);
+
+        if (!flash_receive_chunk(pipeline->fd, pipeline->buffers[chunk.index] + filled, chunk.length - filled))
         {
-            httpd_resp_sendstr(req, "Cannot write to firmware partition.");
-            return ESP_FAIL;
+            upload_failed = true;
+            break;
         }
+
+        filled = 0;
+        remaining -= chunk.length;
+        xQueueSend(pipeline->full_queue, &chunk, portMAX_DELAY);
     }
 
-    free(buffer);
+    // An empty chunk ends the writer, which reports back once it released both buffers.
+    flash_chunk_t end = {.length = 0};
+    xQueueSend(pipeline->full_queue, &end, portMAX_DELAY);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (upload_failed)
+    {
+        ESP_LOGE(TAG, "Image upload failed.");
+        if (!pipeline->write_failed)
+            update_abort();
+
+        flash_respond(pipeline->fd, HTTPD_500, "Image upload failed. Try again!");
+        return false;
+    }
+
+    if (pipeline->write_failed)
+    {
+        flash_respond(pipeline->fd, HTTPD_500, "Cannot write to firmware partition.");
+        return false;
+    }
 
     switch (update_finish())
     {
     case UPDATE_ERR_VALIDATION_FAILED:
-        httpd_resp_sendstr(req, "Image validation failed. Try again!");
-        return ESP_FAIL;
+        flash_respond(pipeline->fd, HTTPD_500, "Image validation failed. Try again!");
+        return false;
 
     case UPDATE_FAILED:
-        httpd_resp_sendstr(req, "Cannot finish firmware update.");
-        return ESP_FAIL;
+        flash_respond(pipeline->fd, HTTPD_500, "Cannot finish firmware update.");
+        return false;
 
     case UPDATE_ERR_CHANGE_BOOT_FAILED:
-        httpd_resp_sendstr(req, "Cannot boot new firmware.");
-        return ESP_FAIL;
+        flash_respond(pipeline->fd, HTTPD_500, "Cannot boot new firmware.");
+        return false;
 
     default:
         break;
     }
 
-    httpd_resp_sendstr(req, "Update succeeded, rebooting.");
-    update_reboot();
-    return ESP_OK;
+    flash_respond(pipeline->fd, HTTPD_200, "Update succeeded, rebooting.");
+    return true;
+}
+
+static bool flash_receive_chunk(int fd, char *buffer, size_t length)
+{
+    uint8_t timeouts = 0;
+
+    while (length > 0)
+    {
+        // The socket keeps the receive timeout the server set up for it.
+        int received = recv(fd, buffer, length, 0);
+
+        // A stalled client is given up on instead of being waited for forever.
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && ++timeouts <= CONFIG_FLASH_RECEIVE_RETRIES)
+            continue;
+
+        if (received <= 0)
+            return false;
+
+        timeouts = 0;
+        buffer += received;
+        length -= received;
+    }
+
+    return true;
+}
+
+static void flash_respond(int fd, const char *status, const char *message)
+{
+    char header[128];
+    int length = snprintf(header, sizeof(header),
+                          "HTTP/1.1 %s\r\n"
+                          "Content-Type: text/html\r\n"
+                          "Content-Length: %u\r\n"
+                          "Connection: close\r\n"
+                          "\r\n",
+                          status, strlen(message));
+
+    if (send(fd, header, length, 0) < 0 || send(fd, message, strlen(message), 0) < 0)
+        ESP_LOGW(TAG, "Failed to send response: %d", errno);
+}
+
+static void flash_write_task(void *arg)
+{
+    flash_pipeline_t *pipeline = arg;
+    size_t remaining = pipeline->image_size;
+    flash_chunk_t chunk;
+
+    while (xQueueReceive(pipeline->full_queue, &chunk, portMAX_DELAY) == pdTRUE && chunk.length > 0)
+    {
+        // After a failed write the remaining chunks are only handed back, so the receiver cannot block.
+        if (!pipeline->write_failed && update_write(pipeline->buffers[chunk.index], chunk.length, &remaining) == UPDATE_FAILED)
+            pipeline->write_failed = true;
+
+        xQueueSend(pipeline->free_queue, &chunk.index, portMAX_DELAY);
+    }
+
+    xTaskNotifyGive(pipeline->receiver);
+    vTaskDelete(NULL);
 }
@@ -4,6 +4,10 @@
 #include "http/actions.h"
 #include "http/status.h"
 #include "http/flash.h"
+#include "http/metrics.h"
+#include "http/events.h"
+#include "http/tail.h"
+#include "http/session.h"
 
 #include "config.h"
 #include "network.h"
@@ -20,8 +24,14 @@ static bool is_initialized = false;
 void http_init()
 {
     config.server_port = CONFIG_HTTP_SERVER_PORT;
+    config.max_uri_handlers = CONFIG_HTTP_MAX_URI_HANDLERS;
+    config.max_open_sockets = CONFIG_HTTP_MAX_OPEN_SOCKETS;
     config.lru_purge_enable = true;
     config.uri_match_fn = &httpd_uri_match_wildcard;
+    config.open_fn = &session_open;
+    config.close_fn = &session_close;
+
+    events_init();
 
     is_initialized = true;
 
@@ -49,15 +59,28 @@ void http_start()
         return;
     }
 
-    httpd_register_uri_handler(server_handle, &index_uri_handler);
+    session_start(server_handle);
+
+    metrics_register_uri_handler(server_handle, &index_uri_handler);
+
+    metrics_register_uri_handler(server_handle, &actions_open_uri_handler);
+    metrics_register_uri_handler(server_handle, &actions_close_uri_handler);
+    metrics_register_uri_handler(server_handle, &actions_stop_uri_handler);
+    metrics_register_uri_handler(server_handle, &actions_position_uri_handler);
+    metrics_register_uri_handler(server_handle, &actions_tilt_uri_handler);
+    metrics_register_uri_handler(server_handle, &actions_batch_uri_handler);
+
+    metrics_register_uri_handler(server_handle, &status_queue_uri_handler);
+    metrics_register_uri_handler(server_handle, &status_boot_uri_handler);
+    metrics_register_uri_handler(server_handle, &status_uri_handler);
 
-    httpd_register_uri_handler(server_handle, &actions_open_uri_handler);
-    httpd_register_uri_handler(server_handle, &actions_close_uri_handler);
-    httpd_register_uri_handler(server_handle, &actions_stop_uri_handler);
+    metrics_register_uri_handler(server_handle, &metrics_uri_handler);
+    metrics_register_uri_handler(server_handle, &trace_uri_handler);
+    metrics_register_uri_handler(server_handle, &tail_uri_handler);
 
-    httpd_register_uri_handler(server_handle, &status_uri_handler);
+    metrics_register_uri_handler(server_handle, &events_uri_handler);
 
-    httpd_register_uri_handler(server_handle, &flash_uri_handler);
+    metrics_register_uri_handler(server_handle, &flash_uri_handler);
 
     ESP_LOGI(TAG, "Started!");
 }
@@ -68,6 +91,8 @@ void http_stop()
         return;
 
     ESP_LOGI(TAG, "Stopping...");
+    session_stop();
+    events_stop();
 
     if (httpd_stop(server_handle) != ESP_OK)
     {
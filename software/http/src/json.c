@@ -0,0 +1,188 @@
+#include "http/json.h"
+
+#include "esp_http_server.h"
+
+static void json_write(json_writer_t *, const char *, size_t);
+static void json_separate(json_writer_t *);
+static void json_flush(json_writer_t *);
+
+void json_begin(json_writer_t *writer, httpd_req_t *req)
+{
+    writer->req = req;
+    writer->err = httpd_resp_set_type(req, "application/json");
+    writer->length = 0;
+    writer->depth = 0;
+    writer->has_value[0] = false;
+    writer->after_key = false;
+}
+
+esp_err_t json_end(json_writer_t *writer)
+{
+    json_flush(writer);
+
+    if (writer->err != ESP_OK)
+        return writer->err;
+
+    return httpd_resp_send_chunk(writer->req, NULL, 0);
+}
+
+void json_object_begin(json_writer_t *writer)
+{
+    json_separate(writer);
+    json_write(writer, "{", 1);
+
+    if (writer->depth + 1 >= JSON_MAX_DEPTH)
+    {
+        writer->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+
+    writer->has_value[++writer->depth] = false;
+}
+
+void json_object_end(json_writer_t *writer)
+{
+    if (writer->depth > 0)
+        writer->depth--;
+
+    json_write(writer, "}", 1);
+}
+
+void json_array_begin(json_writer_t *writer)
+{
+    json_separate(writer);
+    json_write(writer, "[", 1);
+
+    if (writer->depth + 1 >= JSON_MAX_DEPTH)
+    {
+        writer->err = ESP_ERR_INVALID_SIZE;
+        return;
+    }
+
+    writer->has_value[++writer->depth] = false;
+}
+
+void json_array_end(json_writer_t *writer)
+{
+    if (writer->depth > 0)
+        writer->depth--;
+
+    json_write(writer, "]", 1);
+}
+
+void json_key(json_writer_t *writer, const char *key)
+{
+    json_string(writer, key);
+    json_write(writer, ":", 1);
+
+    writer->after_key = true;
+}
+
+void json_int(json_writer_t *writer, int64_t value)
+{
+    char number[24];
+    int length = snprintf(number, sizeof(number), "%" PRId64, value);
+
+    json_separate(writer);
+    json_write(writer, number, length);
+}
+
+void json_bool(json_writer_t *writer, bool value)
+{
+    json_separate(writer);
+
+    if (value)
+        json_write(writer, "true", 4);
+    else
+        json_write(writer, "false", 5);
+}
+
+void json_null(json_writer_t *writer)
+{
+    json_separate(writer);
+    json_write(writer, "null", 4);
+}
+
+void json_string(json_writer_t *writer, const char *value)
+{
+    json_separate(writer);
+    json_write(writer, "\"", 1);
+
+    for (const char *c = value; *c; c++)
+    {
+        char escaped[7];
+
+        switch (*c)
+        {
+        case '"':
+        case '\\':
+            escaped[0] = '\\';
+            escaped[1] = *c;
+            json_write(writer, escaped, 2);
+            break;
+
+        default:
+            if ((unsigned char)*c < 0x20)
+            {
+                snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+                json_write(writer, escaped, 6);
+            }
+            else
+            {
+                json_write(writer, c, 1);
+            }
+            break;
+        }
+    }
+
+    json_write(writer, "\"", 1);
+}
+
+static void json_write(json_writer_t *writer, const char *data, size_t length)
+{
+    if (writer->err != ESP_OK)
+        return;
+
+    while (length > 0)
+    {
+        if (writer->length == JSON_BUFFER_SIZE)
+        {
+            json_flush(writer);
+            if (writer->err != ESP_OK)
+                return;
+        }
+
+        size_t chunk = JSON_BUFFER_SIZE - writer->length;
+        if (chunk > length)
+            chunk = length;
+
+        memcpy(writer->buffer + writer->length, data, chunk);
+        writer->length += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+static void json_separate(json_writer_t *writer)
+{
+    // A value directly after its key needs no comma, every other value but the first does.
+    if (writer->after_key)
+    {
+        writer->after_key = false;
+        return;
+    }
+
+    if (writer->has_value[writer->depth])
+        json_write(writer, ",", 1);
+
+    writer->has_value[writer->depth] = true;
+}
+
+static void json_flush(json_writer_t *writer)
+{
+    if (writer->err != ESP_OK || writer->length == 0)
+        return;
+
+    writer->err = httpd_resp_send_chunk(writer->req, writer->buffer, writer->length);
+    writer->length = 0;
+}
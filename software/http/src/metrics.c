@@ -0,0 +1,419 @@
+#include "http/metrics.h"
+#include "http/session.h"
+
+#include "boot.h"
+#include "config.h"
+#include "logging.h"
+#include "network.h"
+#include "controller/trace.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdarg.h>
+#include <stdatomic.h>
+
+#define METRICS_BUFFER_SIZE 512
+#define METRICS_BUCKET_NUM 10
+
+static const char *const TAG = "HTTP       : Metrics  ";
+
+static const uint32_t METRICS_BUCKET_BOUNDS_US[METRICS_BUCKET_NUM - 1] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000};
+
+// Tasks whose stack usage is reported, missing ones are skipped.
+static const char *const TASK_NAMES[] = {"controller", "httpd", "esp_timer", "sys_evt", "tiT", "Tmr Svc", "wifi", "w5500_tsk", "logging", "mqtt_task", "udp", "flash_receive", "flash_write"};
+
+static const char *const INTERFACE_NAMES[NETWORK_INTERFACE_NUM] = {
+    [NETWORK_INTERFACE_ETHERNET] = "ethernet",
+    [NETWORK_INTERFACE_WIFI] = "wifi",
+};
+
+static const char *const LATENCY_NAMES[TRACE_LATENCY_NUM] = {
+    [TRACE_LATENCY_DISPATCH] = "dispatch",
+    [TRACE_LATENCY_ACTUATION] = "actuation",
+};
+
+static const char *const POINT_NAMES[] = {
+    [TRACE_INPUT_EDGE] = "input_edge",
+    [TRACE_COMMAND_ENQUEUE] = "command_enqueue",
+    [TRACE_HANDLER_START] = "handler_start",
+    [TRACE_COMMAND_SETTLED] = "command_settled",
+    [TRACE_RELAY_ENABLE] = "relay_enable",
+    [TRACE_RELAY_DISABLE] = "relay_disable",
+    [TRACE_RELAY_DIRECTION] = "relay_direction",
+    [TRACE_STOP_TIMEOUT] = "stop_timeout",
+};
+
+typedef struct metrics_endpoint
+{
+    const httpd_uri_t *uri;
+    atomic_uint_fast32_t requests;
+    atomic_uint_fast32_t errors;
+    atomic_uint_fast32_t buckets[METRICS_BUCKET_NUM];
+    atomic_uint_fast64_t sum_us;
+} metrics_endpoint_t;
+
+typedef struct metrics_writer
+{
+    httpd_req_t *req;
+    esp_err_t err;
+    char buffer[METRICS_BUFFER_SIZE];
+    size_t length;
+} metrics_writer_t;
+
+// Slots are kept across server restarts, so the counters keep counting up.
+static metrics_endpoint_t endpoints[CONFIG_HTTP_MAX_URI_HANDLERS];
+static atomic_int_fast64_t first_response_us;
+
+static esp_err_t metrics_handler(httpd_req_t *);
+
+static void metrics_printf(metrics_writer_t *, const char *, ...) __attribute__((format(printf, 2, 3)));
+static esp_err_t metrics_flush(metrics_writer_t *);
+
+static void write_endpoints(metrics_writer_t *);
+static void write_system(metrics_writer_t *);
+static void write_latency(metrics_writer_t *);
+
+static esp_err_t get_metrics_handler(httpd_req_t *);
+static esp_err_t get_trace_handler(httpd_req_t *);
+
+const httpd_uri_t metrics_uri_handler = {
+    .uri = CONFIG_METRICS_URI "/?",
+    .method = HTTP_GET,
+    .handler = &get_metrics_handler,
+    .user_ctx = NULL,
+};
+
+const httpd_uri_t trace_uri_handler = {
+    .uri = CONFIG_TRACE_URI "/?",
+    .method = HTTP_GET,
+    .handler = &get_trace_handler,
+    .user_ctx = NULL,
+};
+
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    metrics_endpoint_t *endpoint = NULL;
+
+    for (uint8_t i = 0; i < CONFIG_HTTP_MAX_URI_HANDLERS && endpoint == NULL; i++)
+    {
+        if (endpoints[i].uri == uri || endpoints[i].uri == NULL)
+            endpoint = &endpoints[i];
+    }
+
+    if (endpoint == NULL)
+        return ESP_ERR_NO_MEM;
+
+    endpoint->uri = uri;
+
+    // The server copies the handler description, the original is reached through the context.
+    httpd_uri_t instrumented = *uri;
+    instrumented.handler = &metrics_handler;
+    instrumented.user_ctx = endpoint;
+
+    return httpd_register_uri_handler(server, &instrumented);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    metrics_endpoint_t *endpoint = req->user_ctx;
+    int64_t start = esp_timer_get_time();
+
+    req->user_ctx = endpoint->uri->user_ctx;
+    esp_err_t err = endpoint->uri->handler(req);
+
+    int64_t end = esp_timer_get_time();
+    uint32_t duration = end - start;
+
+    int_fast64_t expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&first_response_us, &expected, end, memory_order_relaxed, memory_order_relaxed))
+        boot_mark("first_response");
+    uint8_t bucket = 0;
+    while (bucket < METRICS_BUCKET_NUM - 1 && duration > METRICS_BUCKET_BOUNDS_US[bucket])
+        bucket++;
+
+    atomic_fetch_add_explicit(&endpoint->requests, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&endpoint->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&endpoint->sum_us, duration, memory_order_relaxed);
+    if (err != ESP_OK)
+        atomic_fetch_add_explicit(&endpoint->errors, 1, memory_order_relaxed);
+
+    return err;
+}
+
+static esp_err_t get_metrics_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    esp_err_t err = session_track(req);
+    if (err != ESP_OK)
+        return err;
+
+    err = httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    if (err != ESP_OK)
+        return err;
+
+    metrics_writer_t writer = {.req = req, .err = ESP_OK, .length = 0};
+
+    write_system(&writer);
+    write_endpoints(&writer);
+    write_latency(&writer);
+
+    err = metrics_flush(&writer);
+    if (err != ESP_OK)
+        return err;
+
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static void write_system(metrics_writer_t *writer)
+{
+    metrics_printf(writer, "# HELP rcs_uptime_seconds Time since boot.\n"
+                           "# TYPE rcs_uptime_seconds gauge\n"
+                           "rcs_uptime_seconds %.3f\n",
+                   esp_timer_get_time() / 1e6);
+
+    metrics_printf(writer, "# HELP rcs_boot_online_seconds Time from boot to the first IP address, 0 if still offline.\n"
+                           "# TYPE rcs_boot_online_seconds gauge\n"
+                           "rcs_boot_online_seconds %.3f\n"
+                           "# HELP rcs_boot_first_response_seconds Time from boot to the first handled HTTP request.\n"
+                           "# TYPE rcs_boot_first_response_seconds gauge\n"
+                           "rcs_boot_first_response_seconds %.3f\n",
+                   network_query_online_time() / 1e6, atomic_load_explicit(&first_response_us, memory_order_relaxed) / 1e6);
+
+    metrics_printf(writer, "# HELP rcs_heap_free_bytes Currently free heap.\n"
+                           "# TYPE rcs_heap_free_bytes gauge\n"
+                           "rcs_heap_free_bytes %u\n"
+                           "# HELP rcs_heap_free_min_bytes Lowest free heap since boot.\n"
+                           "# TYPE rcs_heap_free_min_bytes gauge\n"
+                           "rcs_heap_free_min_bytes %u\n"
+                           "# HELP rcs_heap_largest_free_block_bytes Largest block that can currently be allocated.\n"
+                           "# TYPE rcs_heap_largest_free_block_bytes gauge\n"
+                           "rcs_heap_largest_free_block_bytes %u\n",
+                   heap_caps_get_free_size(MALLOC_CAP_DEFAULT), heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+                   heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+
+    metrics_printf(writer, "# HELP rcs_task_stack_free_min_bytes Lowest unused stack of a task since it was started.\n"
+                           "# TYPE rcs_task_stack_free_min_bytes gauge\n");
+
+    for (uint8_t i = 0; i < sizeof(TASK_NAMES) / sizeof(TASK_NAMES[0]); i++)
+    {
+        TaskHandle_t task = xTaskGetHandle(TASK_NAMES[i]);
+        if (task == NULL)
+            continue;
+
+        metrics_printf(writer, "rcs_task_stack_free_min_bytes{task=\"%s\"} %u\n", TASK_NAMES[i], uxTaskGetStackHighWaterMark(task));
+    }
+
+    logging_stats_t logging_stats;
+    logging_query_stats(&logging_stats);
+
+    metrics_printf(writer, "# HELP rcs_log_dropped_total Log messages lost to a full buffer.\n"
+                           "# TYPE rcs_log_dropped_total counter\n"
+                           "rcs_log_dropped_total %" PRIu32 "\n"
+                           "# HELP rcs_log_suppressed_total Log messages discarded by the per tag rate limit.\n"
+                           "# TYPE rcs_log_suppressed_total counter\n"
+                           "rcs_log_suppressed_total %" PRIu32 "\n",
+                   logging_stats.dropped, logging_stats.suppressed);
+
+    metrics_printf(writer, "# HELP rcs_network_link_up Whether the interface has a link.\n"
+                           "# TYPE rcs_network_link_up gauge\n");
+
+    for (network_interface_t interface = 0; interface < NETWORK_INTERFACE_NUM; interface++)
+    {
+        network_interface_state_t state;
+        network_query_state(interface, &state);
+
+        metrics_printf(writer, "rcs_network_link_up{interface=\"%s\"} %d\n", INTERFACE_NAMES[interface], state.link_up);
+    }
+
+    metrics_printf(writer, "# HELP rcs_network_connected Whether the interface has an IP address.\n"
+                           "# TYPE rcs_network_connected gauge\n");
+
+    for (network_interface_t interface = 0; interface < NETWORK_INTERFACE_NUM; interface++)
+    {
+        network_interface_state_t state;
+        network_query_state(interface, &state);
+
+        metrics_printf(writer, "rcs_network_connected{interface=\"%s\"} %d\n", INTERFACE_NAMES[interface], state.connected);
+    }
+
+    network_failover_stats_t failover;
+    network_query_failover_stats(&failover);
+
+    metrics_printf(writer, "# HELP rcs_network_failover_active Whether traffic is routed over Wi-Fi after losing Ethernet.\n"
+                           "# TYPE rcs_network_failover_active gauge\n"
+                           "rcs_network_failover_active %d\n",
+                   failover.active);
+    metrics_printf(writer, "# HELP rcs_network_failovers_total Switches from Ethernet to Wi-Fi.\n"
+                           "# TYPE rcs_network_failovers_total counter\n"
+                           "rcs_network_failovers_total %" PRIu32 "\n",
+                   failover.failovers);
+    metrics_printf(writer, "# HELP rcs_network_failover_last_seconds Time from Ethernet link loss to the route over Wi-Fi of the last failover.\n"
+                           "# TYPE rcs_network_failover_last_seconds gauge\n"
+                           "rcs_network_failover_last_seconds %.6f\n",
+                   failover.last_duration_us / 1e6);
+    metrics_printf(writer, "# HELP rcs_network_failover_max_seconds Longest time from Ethernet link loss to the route over Wi-Fi.\n"
+                           "# TYPE rcs_network_failover_max_seconds gauge\n"
+                           "rcs_network_failover_max_seconds %.6f\n",
+                   failover.max_duration_us / 1e6);
+}
+
+static void write_endpoints(metrics_writer_t *writer)
+{
+    metrics_printf(writer, "# HELP rcs_http_requests_total Handled requests per endpoint.\n"
+                           "# TYPE rcs_http_requests_total counter\n");
+
+    for (uint8_t i = 0; i < CONFIG_HTTP_MAX_URI_HANDLERS && endpoints[i].uri != NULL; i++)
+    {
+        const httpd_uri_t *uri = endpoints[i].uri;
+        metrics_printf(writer, "rcs_http_requests_total{endpoint=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                       uri->uri, http_method_str(uri->method), (uint32_t)atomic_load_explicit(&endpoints[i].requests, memory_order_relaxed));
+    }
+
+    metrics_printf(writer, "# HELP rcs_http_errors_total Requests per endpoint whose handler failed.\n"
+                           "# TYPE rcs_http_errors_total counter\n");
+
+    for (uint8_t i = 0; i < CONFIG_HTTP_MAX_URI_HANDLERS && endpoints[i].uri != NULL; i++)
+    {
+        const httpd_uri_t *uri = endpoints[i].uri;
+        metrics_printf(writer, "rcs_http_errors_total{endpoint=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                       uri->uri, http_method_str(uri->method), (uint32_t)atomic_load_explicit(&endpoints[i].errors, memory_order_relaxed));
+    }
+
+    metrics_printf(writer, "# HELP rcs_http_request_duration_seconds Time spent in the handler per endpoint.\n"
+                           "# TYPE rcs_http_request_duration_seconds histogram\n");
+
+    for (uint8_t i = 0; i < CONFIG_HTTP_MAX_URI_HANDLERS && endpoints[i].uri != NULL; i++)
+    {
+        const httpd_uri_t *uri = endpoints[i].uri;
+        const char *method = http_method_str(uri->method);
+        uint32_t cumulative = 0;
+
+        for (uint8_t bucket = 0; bucket < METRICS_BUCKET_NUM; bucket++)
+        {
+            cumulative += atomic_load_explicit(&endpoints[i].buckets[bucket], memory_order_relaxed);
+
+            if (bucket == METRICS_BUCKET_NUM - 1)
+                metrics_printf(writer, "rcs_http_request_duration_seconds_bucket{endpoint=\"%s\",method=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                               uri->uri, method, cumulative);
+            else
+                metrics_printf(writer, "rcs_http_request_duration_seconds_bucket{endpoint=\"%s\",method=\"%s\",le=\"%.4f\"} %" PRIu32 "\n",
+                               uri->uri, method, METRICS_BUCKET_BOUNDS_US[bucket] / 1e6, cumulative);
+        }
+
+        metrics_printf(writer, "rcs_http_request_duration_seconds_sum{endpoint=\"%s\",method=\"%s\"} %.6f\n"
+                               "rcs_http_request_duration_seconds_count{endpoint=\"%s\",method=\"%s\"} %" PRIu32 "\n",
+                       uri->uri, method, atomic_load_explicit(&endpoints[i].sum_us, memory_order_relaxed) / 1e6,
+                       uri->uri, method, cumulative);
+    }
+}
+
+static void write_latency(metrics_writer_t *writer)
+{
+    metrics_printf(writer, "# HELP rcs_channel_latency_seconds Time from switch edge or command to handler start (dispatch) and relay switching (actuation).\n"
+                           "# TYPE rcs_channel_latency_seconds histogram\n");
+
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        for (trace_latency_t latency = 0; latency < TRACE_LATENCY_NUM; latency++)
+        {
+            trace_histogram_t histogram;
+            if (trace_query_histogram(i, latency, &histogram) != ESP_OK)
+                continue;
+
+            // Buckets are stored individually, the exposition format wants them cumulative.
+            uint32_t cumulative = 0;
+            for (uint8_t bucket = 0; bucket < TRACE_BUCKET_NUM; bucket++)
+            {
+                cumulative += histogram.buckets[bucket];
+
+                if (bucket == TRACE_BUCKET_NUM - 1)
+                    metrics_printf(writer, "rcs_channel_latency_seconds_bucket{channel=\"%u\",stage=\"%s\",le=\"+Inf\"} %" PRIu32 "\n",
+                                   i, LATENCY_NAMES[latency], cumulative);
+                else
+                    metrics_printf(writer, "rcs_channel_latency_seconds_bucket{channel=\"%u\",stage=\"%s\",le=\"%.4f\"} %" PRIu32 "\n",
+                                   i, LATENCY_NAMES[latency], trace_bucket_bounds_us[bucket] / 1e6, cumulative);
+            }
+
+            metrics_printf(writer, "rcs_channel_latency_seconds_sum{channel=\"%u\",stage=\"%s\"} %.6f\n"
+                                   "rcs_channel_latency_seconds_count{channel=\"%u\",stage=\"%s\"} %" PRIu32 "\n",
+                           i, LATENCY_NAMES[latency], histogram.sum_us / 1e6, i, LATENCY_NAMES[latency], histogram.count);
+        }
+    }
+}
+
+static void metrics_printf(metrics_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+
+    for (uint8_t attempt = 0; attempt < 2 && writer->err == ESP_OK; attempt++)
+    {
+        va_start(args, format);
+        int length = vsnprintf(writer->buffer + writer->length, sizeof(writer->buffer) - writer->length, format, args);
+        va_end(args);
+
+        if (length < 0)
+        {
+            writer->err = ESP_FAIL;
+            return;
+        }
+
+        if (writer->length + length < sizeof(writer->buffer))
+        {
+            writer->length += length;
+            return;
+        }
+
+        // Lines are never split, a line that does not fit is written again after flushing.
+        if (writer->length == 0)
+        {
+            writer->err = ESP_ERR_INVALID_SIZE;
+            return;
+        }
+
+        metrics_flush(writer);
+    }
+}
+
+static esp_err_t metrics_flush(metrics_writer_t *writer)
+{
+    if (writer->err == ESP_OK && writer->length > 0)
+        writer->err = httpd_resp_send_chunk(writer->req, writer->buffer, writer->length);
+
+    writer->length = 0;
+    return writer->err;
+}
+
+static esp_err_t get_trace_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    esp_err_t err = session_track(req);
+    if (err != ESP_OK)
+        return err;
+
+    err = httpd_resp_set_type(req, "text/plain");
+    if (err != ESP_OK)
+        return err;
+
+    char line[64];
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        trace_entry_t entry;
+        for (uint8_t index = 0; trace_query_entry(i, index, &entry) == ESP_OK; index++)
+        {
+            snprintf(line, sizeof(line), "%u %" PRId64 " %s\n", i, entry.timestamp, POINT_NAMES[entry.point]);
+
+            err = httpd_resp_sendstr_chunk(req, line);
+            if (err != ESP_OK)
+                return err;
+        }
+    }
+
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
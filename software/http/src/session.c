@@ -0,0 +1,184 @@
+#include "http/session.h"
+
+#include "config.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_http_server.h"
+#include "lwip/sockets.h"
+
+static const char *const TAG = "HTTP       : Session  ";
+
+typedef struct session
+{
+    int64_t last_active;
+    uint16_t requests;
+    bool held;
+    bool detached;
+    session_close_func *on_close;
+    void *close_arg;
+} session_t;
+
+static httpd_handle_t session_server = NULL;
+static esp_timer_handle_t sweep_timer = NULL;
+
+static void session_free(void *);
+static int session_detached_recv(httpd_handle_t, int, char *, size_t, int);
+static void session_sweep_handler(void *);
+static void session_sweep(void *);
+
+void session_start(httpd_handle_t server)
+{
+    session_server = server;
+
+    if (sweep_timer == NULL)
+    {
+        esp_timer_create_args_t sweep_timer_config = {
+            .callback = &session_sweep_handler,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "http_sweep",
+        };
+
+        ESP_ERROR_CHECK(esp_timer_create(&sweep_timer_config, &sweep_timer));
+    }
+
+    ESP_ERROR_CHECK(esp_timer_start_periodic(sweep_timer, CONFIG_HTTP_KEEP_ALIVE_SWEEP_MS * 1000));
+}
+
+void session_stop()
+{
+    if (sweep_timer != NULL)
+        esp_timer_stop(sweep_timer);
+
+    session_server = NULL;
+}
+
+esp_err_t session_track(httpd_req_t *req)
+{
+    session_t *session = req->sess_ctx;
+
+    if (session == NULL)
+    {
+        session = calloc(1, sizeof(session_t));
+        if (session == NULL)
+            return httpd_resp_set_hdr(req, "Connection", "close");
+
+        req->sess_ctx = session;
+        req->free_ctx = &session_free;
+    }
+
+    session->last_active = esp_timer_get_time();
+    session->requests++;
+
+    if (session->requests < CONFIG_HTTP_KEEP_ALIVE_MAX_REQUESTS)
+        return httpd_resp_set_hdr(req, "Connection", "keep-alive");
+
+    // The server closes the socket once this response is sent.
+    ESP_LOGD(TAG, "Closing connection after %u requests.", session->requests);
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+
+    return httpd_resp_set_hdr(req, "Connection", "close");
+}
+
+esp_err_t session_hold(httpd_req_t *req, session_close_func *on_close, void *arg)
+{
+    session_t *session = req->sess_ctx;
+
+    if (session == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    // Held sessions stream responses and are exempt from the idle sweep.
+    session->held = true;
+    session->on_close = on_close;
+    session->close_arg = arg;
+
+    return ESP_OK;
+}
+
+esp_err_t session_detach(httpd_req_t *req, session_close_func *on_release, void *arg)
+{
+    session_t *session = req->sess_ctx;
+
+    if (session == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    int fd = httpd_req_to_sockfd(req);
+
+    session->held = true;
+    session->detached = true;
+    session->on_close = on_release;
+    session->close_arg = arg;
+
+    // The server drops the session instead of reading the rest of the body, session_close keeps the socket open.
+    esp_err_t err = httpd_sess_set_recv_override(req->handle, fd, &session_detached_recv);
+    if (err != ESP_OK)
+        return err;
+
+    return httpd_sess_trigger_close(req->handle, fd);
+}
+
+esp_err_t session_open(httpd_handle_t server, int fd)
+{
+    // Headers and body go out in separate writes, with Nagle a kept connection waits for a delayed ACK between them.
+    int enable = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)) != 0)
+        ESP_LOGW(TAG, "Failed to disable Nagle on socket %d.", fd);
+
+    return ESP_OK;
+}
+
+void session_close(httpd_handle_t server, int fd)
+{
+    session_t *session = httpd_sess_get_ctx(server, fd);
+
+    if (session == NULL || !session->detached)
+        close(fd);
+}
+
+static int session_detached_recv(httpd_handle_t server, int fd, char *buffer, size_t length, int flags)
+{
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+static void session_free(void *ctx)
+{
+    session_t *session = ctx;
+
+    if (session->on_close != NULL)
+        session->on_close(session->close_arg);
+
+    free(session);
+}
+
+static void session_sweep_handler(void *arg)
+{
+    if (session_server == NULL)
+        return;
+
+    // Sessions may only be inspected from within the server task.
+    httpd_queue_work(session_server, &session_sweep, session_server);
+}
+
+static void session_sweep(void *arg)
+{
+    httpd_handle_t server = arg;
+    int64_t now = esp_timer_get_time();
+
+    size_t fd_count = CONFIG_HTTP_MAX_OPEN_SOCKETS;
+    int fds[CONFIG_HTTP_MAX_OPEN_SOCKETS];
+
+    if (httpd_get_client_list(server, &fd_count, fds) != ESP_OK)
+        return;
+
+    for (size_t i = 0; i < fd_count; i++)
+    {
+        session_t *session = httpd_sess_get_ctx(server, fds[i]);
+
+        // Sockets without a request yet are left to the LRU purge.
+        if (session == NULL || session->held || now - session->last_active < CONFIG_HTTP_KEEP_ALIVE_IDLE_TIMEOUT_SEC * 1000000LL)
+            continue;
+
+        ESP_LOGD(TAG, "Closing idle connection %d.", fds[i]);
+        httpd_sess_trigger_close(server, fds[i]);
+    }
+}
@@ -1,14 +1,22 @@
 #include "http/status.h"
+#include "http/session.h"
+#include "http/json.h"
 
+#include "boot.h"
 #include "config.h"
 #include "controller.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_http_server.h"
 
 static const char *const TAG = "HTTP       : Status   ";
 
 static esp_err_t get_status_handler(httpd_req_t *);
+static esp_err_t get_status_queue_handler(httpd_req_t *);
+static esp_err_t get_status_boot_handler(httpd_req_t *);
+
+static void write_channel(json_writer_t *, const controller_channel_state_t *, int64_t);
 
 const httpd_uri_t status_uri_handler = {
     .uri = CONFIG_STATUS_URI "/?*",
@@ -17,60 +25,153 @@ const httpd_uri_t status_uri_handler = {
     .user_ctx = NULL,
 };
 
+const httpd_uri_t status_queue_uri_handler = {
+    .uri = CONFIG_STATUS_QUEUE_URI "/?",
+    .method = HTTP_GET,
+    .handler = &get_status_queue_handler,
+    .user_ctx = NULL,
+};
+
+const httpd_uri_t status_boot_uri_handler = {
+    .uri = CONFIG_STATUS_BOOT_URI "/?",
+    .method = HTTP_GET,
+    .handler = &get_status_boot_handler,
+    .user_ctx = NULL,
+};
+
 static esp_err_t get_status_handler(httpd_req_t *req)
 {
     ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
 
-    size_t length = 64;
-    char *response = calloc(length, sizeof(char));
+    bool all = !strcmp(req->uri, CONFIG_STATUS_URI) || !strcmp(req->uri, CONFIG_STATUS_URI "/");
+    uint64_t channel = 0;
 
-    if (!strcmp(req->uri, CONFIG_STATUS_URI) || !strcmp(req->uri, CONFIG_STATUS_URI "/"))
+    if (!all)
     {
-        int8_t *status = controller_query_all();
+        char *end;
+        const char *start = req->uri + strlen(CONFIG_STATUS_URI "/");
+        channel = strtoul(start, &end, 10);
 
-        strcat(response, "[ ");
+        if (channel >= CONFIG_CONTROLLER_CHANNEL_NUM || end == start || *end)
+            return ESP_ERR_INVALID_ARG;
+    }
 
-        char tmp[8];
-        while (*status != -1)
-        {
-            snprintf(tmp, 8, "%d, ", *status);
-            status++;
+    esp_err_t err = session_track(req);
+    if (err != ESP_OK)
+        return err;
 
-            if (strlen(response) + strlen(tmp) > length)
-            {
-                length *= 2;
-                response = realloc(response, sizeof(char) * length);
-            }
+    controller_snapshot_t snapshot;
+    controller_query_all(&snapshot);
 
-            strcat(response, tmp);
-        }
+    int64_t now = esp_timer_get_time();
+    json_writer_t writer;
+    json_begin(&writer, req);
 
-        size_t len = strlen(response);
-        response[len - 2] = ' ';
-        response[len - 1] = ']';
-    }
-    else
+    if (!all)
     {
-        char *end;
-        const char *start = req->uri + strlen(CONFIG_STATUS_URI "/");
-        uint64_t channel = strtoul(start, &end, 10);
+        write_channel(&writer, &snapshot.channels[channel], now);
+        return json_end(&writer);
+    }
 
-        if (channel > 255 || end == start || *end)
-            return ESP_ERR_INVALID_ARG;
+    json_array_begin(&writer);
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+        write_channel(&writer, &snapshot.channels[i], now);
+    json_array_end(&writer);
 
-        int8_t status = controller_query((uint8_t)channel);
-        snprintf(response, length, "%d", status);
-    }
+    return json_end(&writer);
+}
+
+static esp_err_t get_status_queue_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
 
-    esp_err_t err = httpd_resp_set_hdr(req, "Connection", "close");
+    esp_err_t err = session_track(req);
     if (err != ESP_OK)
         return err;
 
-    err = httpd_resp_set_hdr(req, "Content-Type", "application/json");
+    json_writer_t writer;
+    json_begin(&writer, req);
+    json_array_begin(&writer);
+
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        controller_queue_stats_t stats;
+        controller_query_queue(i, &stats);
+
+        json_object_begin(&writer);
+        json_key(&writer, "posted");
+        json_int(&writer, stats.posted);
+        json_key(&writer, "coalesced");
+        json_int(&writer, stats.coalesced);
+        json_key(&writer, "dropped");
+        json_int(&writer, stats.dropped);
+        json_key(&writer, "depth");
+        json_int(&writer, stats.depth);
+        json_key(&writer, "max_depth");
+        json_int(&writer, stats.max_depth);
+        json_object_end(&writer);
+    }
+
+    json_array_end(&writer);
+    return json_end(&writer);
+}
+
+static esp_err_t get_status_boot_handler(httpd_req_t *req)
+{
+    ESP_LOGI(TAG, "Received request at \"%s\"", req->uri);
+
+    esp_err_t err = session_track(req);
     if (err != ESP_OK)
         return err;
 
-    err = httpd_resp_sendstr(req, response);
-    free(response);
-    return err;
+    boot_stage_t stages[BOOT_STAGE_NUM];
+    uint8_t stage_num = boot_query_stages(stages);
+
+    json_writer_t writer;
+    json_begin(&writer, req);
+    json_array_begin(&writer);
+
+    for (uint8_t i = 0; i < stage_num; i++)
+    {
+        json_object_begin(&writer);
+        json_key(&writer, "stage");
+        json_string(&writer, stages[i].name);
+        json_key(&writer, "time_us");
+        json_int(&writer, stages[i].time_us);
+        json_object_end(&writer);
+    }
+
+    json_array_end(&writer);
+    return json_end(&writer);
+}
+
+static void write_channel(json_writer_t *writer, const controller_channel_state_t *state, int64_t now)
+{
+    json_object_begin(writer);
+
+    json_key(writer, "state");
+    json_int(writer, state->commanded);
+
+    json_key(writer, "running");
+    json_int(writer, state->running);
+
+    json_key(writer, "moving");
+    json_bool(writer, state->moving);
+
+    json_key(writer, "position");
+    if (state->position < 0)
+        json_null(writer);
+    else
+        json_int(writer, state->position);
+
+    json_key(writer, "tilt");
+    if (state->tilt < 0)
+        json_null(writer);
+    else
+        json_int(writer, state->tilt);
+
+    json_key(writer, "since_ms");
+    json_int(writer, (now - state->changed_at) / 1000);
+
+    json_object_end(writer);
 }
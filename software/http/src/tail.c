@@ -0,0 +1,68 @@
+#include "http/tail.h"
+#include "http/session.h"
+
+#include "config.h"
+#include "logging.h"
+
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+static const char *const TAG = "HTTP       : Tail     ";
+
+static esp_err_t get_tail_handler(httpd_req_t *);
+
+const httpd_uri_t tail_uri_handler = {
+    .uri = CONFIG_LOG_URI "/?*",
+    .method = HTTP_GET,
+    .handler = &get_tail_handler,
+    .user_ctx = NULL,
+};
+
+static esp_err_t get_tail_handler(httpd_req_t *req)
+{
+    ESP_LOGD(TAG, "Received request at \"%s\"", req->uri);
+
+    char params[32];
+    char value[12];
+    uint32_t position = 0;
+
+    // Clients polling the log pass the position of their last response to only get new lines.
+    if (httpd_req_get_url_query_str(req, params, sizeof(params)) == ESP_OK &&
+        httpd_query_key_value(params, "since", value, sizeof(value)) == ESP_OK)
+    {
+        char *end;
+        position = strtoul(value, &end, 10);
+
+        if (end == value || *end)
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t end_position = logging_query_tail_position();
+
+    char end_position_str[12];
+    snprintf(end_position_str, sizeof(end_position_str), "%" PRIu32, end_position);
+
+    esp_err_t err = httpd_resp_set_hdr(req, "X-Log-Position", end_position_str);
+    if (err != ESP_OK)
+        return err;
+
+    err = httpd_resp_set_type(req, "text/plain");
+    if (err != ESP_OK)
+        return err;
+
+    err = session_track(req);
+    if (err != ESP_OK)
+        return err;
+
+    char buffer[256];
+    size_t length;
+
+    while (position < end_position && (length = logging_read_tail(&position, buffer, sizeof(buffer))) > 0)
+    {
+        err = httpd_resp_send_chunk(req, buffer, length);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
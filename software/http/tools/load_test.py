@@ -0,0 +1,136 @@
+"""Poll a device over HTTP from several clients and report requests per second and latency percentiles.
+
+Every client polls /status and, with --action-every, posts a stop action to a channel every so many requests
+and follows its 303 redirect to the index like a browser. Each mode is run in turn: `close` opens a connection
+for every request and asks the server to close it, which is what every request cost while the firmware forced
+`Connection: close`, and `keep-alive` reuses one connection per client for as long as the server keeps it.
+
+    python load_test.py --host 192.168.1.50 --clients 4 --requests 500 --action-every 10
+"""
+
+import argparse
+import http.client
+import statistics
+import threading
+import time
+
+MODES = ("close", "keep-alive")
+
+
+class Client:
+    def __init__(self, host, port, timeout, keep_alive):
+        self.host = host
+        self.port = port
+        self.timeout = timeout
+        self.keep_alive = keep_alive
+        self.connection = None
+        self.connects = 0
+
+    def request(self, method, path):
+        headers = {} if self.keep_alive else {"Connection": "close"}
+
+        # A kept connection may have been closed by the server meanwhile, a request on it is retried once on a new one.
+        for attempt in range(2):
+            if self.connection is None or self.connection.sock is None:
+                self.connection = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+                self.connection.connect()
+                self.connects += 1
+                reused = False
+            else:
+                reused = True
+
+            try:
+                self.connection.request(method, path, headers=headers)
+                response = self.connection.getresponse()
+                response.read()
+            except (http.client.RemoteDisconnected, ConnectionResetError, BrokenPipeError):
+                self.close()
+                if reused and attempt == 0:
+                    continue
+                raise
+
+            if not self.keep_alive or response.will_close:
+                self.close()
+
+            return response
+
+    def close(self):
+        if self.connection is not None:
+            self.connection.close()
+            self.connection = None
+
+
+def run_client(args, keep_alive, latencies, errors):
+    client = Client(args.host, args.port, args.timeout, keep_alive)
+
+    for request in range(args.requests):
+        start = time.perf_counter()
+
+        # An action and its redirect count as one request, like the round trip of a browser.
+        try:
+            if args.action_every and request % args.action_every == args.action_every - 1:
+                response = client.request("POST", f"/actions/stop/{args.channel}")
+                location = response.getheader("Location")
+                if response.status == 303 and location:
+                    client.request("GET", location)
+            else:
+                client.request("GET", "/status")
+        except OSError as error:
+            errors.append(error)
+            continue
+
+        latencies.append(time.perf_counter() - start)
+
+    client.close()
+    return client.connects
+
+
+def run_mode(args, mode):
+    latencies = []
+    errors = []
+    connects = []
+
+    def worker():
+        connects.append(run_client(args, mode == "keep-alive", latencies, errors))
+
+    threads = [threading.Thread(target=worker) for _ in range(args.clients)]
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    if not latencies:
+        print(f"{mode}: no successful requests, {len(errors)} errors")
+        return False
+
+    latencies.sort()
+    p99 = latencies[min(len(latencies) - 1, len(latencies) * 99 // 100)]
+    print(
+        f"{mode:>10}: {len(latencies) / elapsed:8.1f} requests/s, median {statistics.median(latencies) * 1e3:7.2f} ms, "
+        f"p99 {p99 * 1e3:7.2f} ms, max {latencies[-1] * 1e3:7.2f} ms, {sum(connects)} connections, {len(errors)} errors"
+    )
+    return not errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", required=True, help="address of the device")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--clients", type=int, default=4, help="clients polling at the same time")
+    parser.add_argument("--requests", type=int, default=500, help="requests of every client and mode")
+    parser.add_argument("--action-every", type=int, default=0, help="post a stop action every n requests, 0 for none")
+    parser.add_argument("--channel", type=int, default=0, help="channel the stop actions go to")
+    parser.add_argument("--mode", choices=MODES, action="append", help="mode to run, all of them by default")
+    parser.add_argument("--timeout", type=float, default=5, help="seconds to wait for a response")
+    args = parser.parse_args()
+
+    print(f"{args.clients} clients, {args.requests} requests each, action every {args.action_every or 'never'}")
+    results = [run_mode(args, mode) for mode in args.mode or MODES]
+
+    return 0 if all(results) else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
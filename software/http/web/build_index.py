@@ -0,0 +1,49 @@
+"""Extract the index page from the preprocessed index.page.c, minify and gzip it."""
+
+import gzip
+import re
+import sys
+
+LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+
+
+def extract(source):
+    position = source.index("=", source.index("INDEX_PAGE")) + 1
+    literals = []
+
+    # Adjacent string literals up to the terminating semicolon form the page.
+    while True:
+        while source[position].isspace():
+            position += 1
+
+        match = LITERAL.match(source, position)
+        if match is None:
+            break
+
+        literals.append(match.group(1))
+        position = match.end()
+
+    return "".join(literal.encode("latin-1").decode("unicode_escape") for literal in literals)
+
+
+def minify(page):
+    page = re.sub(r">\s+<", "><", page)
+    page = re.sub(r"\s+", " ", page)
+    return page.strip()
+
+
+def main(source_path, output_path):
+    with open(source_path, encoding="utf-8") as source:
+        page = minify(extract(source.read()))
+
+    # A fixed mtime keeps the output reproducible for identical pages.
+    compressed = gzip.compress(page.encode("utf-8"), compresslevel=9, mtime=0)
+
+    with open(output_path, "wb") as output:
+        output.write(compressed)
+
+    print(f"Index page: {len(page)} bytes minified, {len(compressed)} bytes compressed.")
+
+
+if __name__ == "__main__":
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,67 @@
+// Not compiled into the firmware. The build only runs this file through the preprocessor
+// to resolve the profile, then build_index.py minifies and compresses the page.
+#include "sdkconfig.h"
+#include "config.h"
+
+#define INDEX_DEFINE_CHANNEL(num) "\
+        <form method='post'>\
+            <label style='line-height:1.5'>Channel " #num ":</label>\
+            <input type='submit' value='Open' formaction='/actions/open/" #num "' />\
+            <input type='submit' value='Close' formaction='/actions/close/" #num "' />\
+            <input type='submit' value='Stop' formaction='/actions/stop/" #num "' />\
+            <input type='number' name='pct' min='0' max='100' style='width:4em' />\
+            <input type='submit' value='Move' formaction='/actions/position/" #num "' />\
+            <input type='number' name='angle' min='0' max='90' style='width:4em' />\
+            <input type='submit' value='Tilt' formaction='/actions/tilt/" #num "' />\
+        </form>"
+
+// clang-format off
+INDEX_PAGE = "\
+<!DOCTYPE html>\
+<html lang='en'>\
+    <head>\
+        <meta charset='UTF-8'>\
+        <title>" CONFIG_INDEX_TITLE "</title>\
+    </head>\
+    <body>\
+        <h1>Raffstore Control System</h1>\
+        <p>Version: " CONFIG_APP_PROJECT_VER "</p>\
+        <p>Profile: " CONFIG_INDEX_TITLE "</p>"
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 0
+        "\
+        <h2>Controls</h2>\
+        <form method='post'>\
+            <label style='line-height:1.5'>All Channels:</label>\
+            <input type='submit' value='Open' formaction='/actions/open' />\
+            <input type='submit' value='Close' formaction='/actions/close' />\
+            <input type='submit' value='Stop' formaction='/actions/stop' />\
+            <input type='number' name='pct' min='0' max='100' style='width:4em' />\
+            <input type='submit' value='Move' formaction='/actions/position' />\
+            <input type='number' name='angle' min='0' max='90' style='width:4em' />\
+            <input type='submit' value='Tilt' formaction='/actions/tilt' />\
+        </form>\
+        <br>"
+        INDEX_DEFINE_CHANNEL(0)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 1
+        INDEX_DEFINE_CHANNEL(1)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 2
+        INDEX_DEFINE_CHANNEL(2)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 3
+        INDEX_DEFINE_CHANNEL(3)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 4
+        INDEX_DEFINE_CHANNEL(4)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 5
+        INDEX_DEFINE_CHANNEL(5)
+#endif
+#if CONFIG_CONTROLLER_CHANNEL_NUM > 6
+        INDEX_DEFINE_CHANNEL(6)
+#endif
+        "\
+    </body>\
+</html>";
+// clang-format on
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct logging_stats
+{
+    uint32_t dropped;
+    uint32_t suppressed;
+} logging_stats_t;
+
+void logging_init();
+void logging_init_syslog();
+
+size_t logging_read_tail(uint32_t *position, char *buffer, size_t buffer_size);
+uint32_t logging_query_tail_position();
+void logging_query_stats(logging_stats_t *stats_out);
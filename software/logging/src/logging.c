@@ -0,0 +1,698 @@
+#include "logging.h"
+
+#include "config.h"
+#include "network.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOGGING_RECORD_DATA_SIZE 56
+#define LOGGING_LINE_SIZE 256
+#define LOGGING_SPEC_SIZE 24
+#define LOGGING_SLOT_MASK (CONFIG_LOGGING_BUFFER_SLOTS - 1)
+
+#define LOGGING_SYSLOG_FACILITY 16
+
+static const char *const TAG = "Logging    ";
+
+_Static_assert((CONFIG_LOGGING_BUFFER_SLOTS & LOGGING_SLOT_MASK) == 0, "CONFIG_LOGGING_BUFFER_SLOTS must be a power of two.");
+
+typedef enum logging_arg
+{
+    LOGGING_ARG_NONE,
+    LOGGING_ARG_INT,
+    LOGGING_ARG_LONG,
+    LOGGING_ARG_LONG_LONG,
+    LOGGING_ARG_SIZE,
+    LOGGING_ARG_POINTER,
+    LOGGING_ARG_DOUBLE,
+    LOGGING_ARG_STRING,
+} logging_arg_t;
+
+typedef struct logging_spec
+{
+    const char *start;
+    size_t length;
+    uint8_t stars;
+    logging_arg_t arg;
+} logging_spec_t;
+
+// Arguments are stored in binary, the line is only formatted by the logging task.
+typedef struct logging_record
+{
+    const char *format;
+    uint8_t length;
+    bool truncated;
+    uint8_t data[LOGGING_RECORD_DATA_SIZE];
+} logging_record_t;
+
+typedef struct logging_slot
+{
+    atomic_uint_fast32_t sequence;
+    logging_record_t record;
+} logging_slot_t;
+
+typedef struct logging_rate
+{
+    _Atomic(const char *) tag;
+    atomic_uint_fast32_t window;
+    atomic_uint_fast32_t count;
+    atomic_uint_fast32_t suppressed;
+} logging_rate_t;
+
+static logging_slot_t slots[CONFIG_LOGGING_BUFFER_SLOTS];
+static atomic_uint_fast32_t enqueue_position = 0;
+static uint32_t dequeue_position = 0;
+
+static logging_rate_t rates[CONFIG_LOGGING_RATE_TAGS];
+static atomic_uint_fast32_t dropped = 0;
+static atomic_uint_fast32_t suppressed = 0;
+
+#if CONFIG_LOGGING_TAIL_SIZE > 0
+static char tail[CONFIG_LOGGING_TAIL_SIZE];
+static uint32_t tail_position = 0;
+static portMUX_TYPE tail_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+static int syslog_socket = -1;
+static struct sockaddr_in syslog_address;
+static atomic_bool is_network_connected = false;
+#endif
+
+static int logging_vprintf(const char *, va_list);
+static bool logging_allow(const char *);
+static bool logging_push(logging_record_t *, const void *, size_t);
+static bool logging_enqueue(const logging_record_t *);
+static bool logging_dequeue(logging_record_t *);
+
+static void logging_task(void *);
+static size_t logging_format(const logging_record_t *, char *, size_t);
+static void logging_append(char *, size_t, size_t *, const char *, size_t);
+static const char *logging_parse_spec(const char *, logging_spec_t *);
+static bool logging_is_tag(const logging_spec_t *, const char *);
+static void logging_report(char *, size_t);
+static void logging_emit(char *, size_t);
+static size_t logging_strip(char *, size_t);
+
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+static void logging_connect_handler();
+#endif
+
+void logging_init()
+{
+    for (uint32_t i = 0; i < CONFIG_LOGGING_BUFFER_SLOTS; i++)
+        atomic_init(&slots[i].sequence, i);
+
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+    syslog_address.sin_family = AF_INET;
+    syslog_address.sin_port = htons(CONFIG_LOGGING_SYSLOG_PORT);
+    inet_pton(AF_INET, CONFIG_LOGGING_SYSLOG_HOST, &syslog_address.sin_addr);
+#endif
+
+    BaseType_t err = xTaskCreate(&logging_task, "logging", CONFIG_LOGGING_TASK_STACK_SIZE, NULL, CONFIG_LOGGING_TASK_PRIORITY, NULL);
+    if (err != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create task, logging stays synchronous.");
+        return;
+    }
+
+    esp_log_set_vprintf(&logging_vprintf);
+}
+
+void logging_init_syslog()
+{
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+    ESP_LOGI(TAG, "Register network handlers.");
+    network_register_connect_handler(&logging_connect_handler);
+#endif
+}
+
+size_t logging_read_tail(uint32_t *position, char *buffer, size_t buffer_size)
+{
+#if CONFIG_LOGGING_TAIL_SIZE > 0
+    portENTER_CRITICAL(&tail_lock);
+
+    // Positions that were already overwritten or lie in the future start at the oldest byte.
+    uint32_t oldest = tail_position > CONFIG_LOGGING_TAIL_SIZE ? tail_position - CONFIG_LOGGING_TAIL_SIZE : 0;
+    if (*position < oldest || *position > tail_position)
+        *position = oldest;
+
+    size_t length = tail_position - *position;
+    if (length > buffer_size)
+        length = buffer_size;
+
+    for (size_t i = 0; i < length; i++)
+        buffer[i] = tail[(*position + i) % CONFIG_LOGGING_TAIL_SIZE];
+
+    *position += length;
+    portEXIT_CRITICAL(&tail_lock);
+
+    return length;
+#else
+    return 0;
+#endif
+}
+
+uint32_t logging_query_tail_position()
+{
+#if CONFIG_LOGGING_TAIL_SIZE > 0
+    portENTER_CRITICAL(&tail_lock);
+    uint32_t position = tail_position;
+    portEXIT_CRITICAL(&tail_lock);
+
+    return position;
+#else
+    return 0;
+#endif
+}
+
+void logging_query_stats(logging_stats_t *stats_out)
+{
+    stats_out->dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+    stats_out->suppressed = atomic_load_explicit(&suppressed, memory_order_relaxed);
+}
+
+static int logging_vprintf(const char *format, va_list args)
+{
+    logging_record_t record = {.format = format, .length = 0, .truncated = false};
+    const char *tag = NULL;
+    const char *next = format;
+    logging_spec_t spec;
+
+    // Only the arguments are captured here, which is much cheaper than formatting them.
+    while (!record.truncated && (next = logging_parse_spec(next, &spec)) != NULL)
+    {
+        for (uint8_t i = 0; i < spec.stars; i++)
+        {
+            int value = va_arg(args, int);
+            logging_push(&record, &value, sizeof(value));
+        }
+
+        switch (spec.arg)
+        {
+        case LOGGING_ARG_INT:;
+            int int_value = va_arg(args, int);
+            logging_push(&record, &int_value, sizeof(int_value));
+            break;
+
+        case LOGGING_ARG_LONG:;
+            long long_value = va_arg(args, long);
+            logging_push(&record, &long_value, sizeof(long_value));
+            break;
+
+        case LOGGING_ARG_LONG_LONG:;
+            long long long_long_value = va_arg(args, long long);
+            logging_push(&record, &long_long_value, sizeof(long_long_value));
+            break;
+
+        case LOGGING_ARG_SIZE:;
+            size_t size_value = va_arg(args, size_t);
+            logging_push(&record, &size_value, sizeof(size_value));
+            break;
+
+        case LOGGING_ARG_POINTER:;
+            void *pointer_value = va_arg(args, void *);
+            logging_push(&record, &pointer_value, sizeof(pointer_value));
+            break;
+
+        case LOGGING_ARG_DOUBLE:;
+            double double_value = va_arg(args, double);
+            logging_push(&record, &double_value, sizeof(double_value));
+            break;
+
+        case LOGGING_ARG_STRING:;
+            const char *string = va_arg(args, const char *);
+            if (string == NULL)
+                string = "(null)";
+
+            // Tags are static, other strings may be temporary and are copied and cut to the remaining space.
+            if (tag == NULL && logging_is_tag(&spec, next))
+            {
+                tag = string;
+                logging_push(&record, &tag, sizeof(tag));
+                break;
+            }
+
+            size_t space = LOGGING_RECORD_DATA_SIZE - record.length;
+            size_t length = strnlen(string, space);
+
+            if (length == space)
+            {
+                record.truncated = true;
+                if (space == 0)
+                    break;
+
+                length--;
+            }
+
+            memcpy(record.data + record.length, string, length);
+            record.data[record.length + length] = '\0';
+            record.length += length + 1;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    // Errors and warnings are never limited.
+    const char *color_end = format[0] == '\033' ? strchr(format, 'm') : NULL;
+    char level = color_end != NULL ? color_end[1] : format[0];
+    if (level != 'E' && level != 'W' && tag != NULL && !logging_allow(tag))
+        return 0;
+
+    if (!logging_enqueue(&record))
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+
+    return 0;
+}
+
+static bool logging_allow(const char *tag)
+{
+    uint32_t window = esp_timer_get_time() / (CONFIG_LOGGING_RATE_WINDOW_MS * 1000);
+
+    for (uint8_t i = 0; i < CONFIG_LOGGING_RATE_TAGS; i++)
+    {
+        logging_rate_t *rate = &rates[i];
+        const char *current = atomic_load_explicit(&rate->tag, memory_order_acquire);
+
+        if (current == NULL)
+        {
+            if (atomic_compare_exchange_strong(&rate->tag, &current, tag))
+                current = tag;
+        }
+
+        if (current != tag)
+            continue;
+
+        uint_fast32_t seen = atomic_load_explicit(&rate->window, memory_order_relaxed);
+        if (seen != window && atomic_compare_exchange_strong(&rate->window, &seen, window))
+            atomic_store_explicit(&rate->count, 0, memory_order_relaxed);
+
+        if (atomic_fetch_add_explicit(&rate->count, 1, memory_order_relaxed) < CONFIG_LOGGING_RATE_LIMIT)
+            return true;
+
+        atomic_fetch_add_explicit(&rate->suppressed, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+
+    // Tags beyond the table are not limited.
+    return true;
+}
+
+static bool logging_push(logging_record_t *record, const void *value, size_t size)
+{
+    if (record->length + size > LOGGING_RECORD_DATA_SIZE)
+    {
+        record->truncated = true;
+        return false;
+    }
+
+    memcpy(record->data + record->length, value, size);
+    record->length += size;
+    return true;
+}
+
+static bool logging_enqueue(const logging_record_t *record)
+{
+    // Bounded multi producer queue, producers only contend on the position counter.
+    uint_fast32_t position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+    logging_slot_t *slot;
+
+    while (true)
+    {
+        slot = &slots[position & LOGGING_SLOT_MASK];
+        int32_t difference = (int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+
+        if (difference < 0)
+            return false;
+
+        if (difference == 0 && atomic_compare_exchange_weak_explicit(&enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            break;
+
+        if (difference > 0)
+            position = atomic_load_explicit(&enqueue_position, memory_order_relaxed);
+    }
+
+    slot->record = *record;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    return true;
+}
+
+static bool logging_dequeue(logging_record_t *record)
+{
+    logging_slot_t *slot = &slots[dequeue_position & LOGGING_SLOT_MASK];
+
+    if ((int32_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - (dequeue_position + 1)) < 0)
+        return false;
+
+    *record = slot->record;
+    atomic_store_explicit(&slot->sequence, dequeue_position + CONFIG_LOGGING_BUFFER_SLOTS, memory_order_release);
+    dequeue_position++;
+
+    return true;
+}
+
+static void logging_task(void *arg)
+{
+    logging_record_t record;
+    char line[LOGGING_LINE_SIZE];
+
+    while (true)
+    {
+        while (logging_dequeue(&record))
+            logging_emit(line, logging_format(&record, line, sizeof(line)));
+
+        logging_report(line, sizeof(line));
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_LOGGING_DRAIN_MS));
+    }
+}
+
+#define LOGGING_FORMAT_VALUE(type)                                                        \
+    do                                                                                    \
+    {                                                                                     \
+        type value;                                                                       \
+        if (data + sizeof(value) > end)                                                   \
+            goto truncated;                                                               \
+        memcpy(&value, data, sizeof(value));                                              \
+        data += sizeof(value);                                                            \
+        written = snprintf(line + length, line_size - length, spec_format, value);        \
+    } while (0)
+
+static size_t logging_format(const logging_record_t *record, char *line, size_t line_size)
+{
+    const uint8_t *data = record->data;
+    const uint8_t *end = record->data + record->length;
+    const char *literal = record->format;
+    size_t length = 0;
+    bool tag_seen = false;
+    logging_spec_t spec;
+
+    while (true)
+    {
+        const char *next = logging_parse_spec(literal, &spec);
+        logging_append(line, line_size, &length, literal, (next ? spec.start : literal + strlen(literal)) - literal);
+
+        if (next == NULL)
+            break;
+
+        literal = next;
+
+        // Star widths are written into the conversion, so every value is formatted with a single argument.
+        char spec_format[LOGGING_SPEC_SIZE];
+        size_t spec_length = 0;
+
+        for (size_t i = 0; i < spec.length && spec_length < sizeof(spec_format) - 12; i++)
+        {
+            if (spec.start[i] != '*')
+            {
+                spec_format[spec_length++] = spec.start[i];
+                continue;
+            }
+
+            int star;
+            if (data + sizeof(star) > end)
+                goto truncated;
+
+            memcpy(&star, data, sizeof(star));
+            data += sizeof(star);
+            spec_length += snprintf(spec_format + spec_length, sizeof(spec_format) - spec_length, "%d", star);
+        }
+
+        spec_format[spec_length] = '\0';
+        int written = 0;
+
+        switch (spec.arg)
+        {
+        case LOGGING_ARG_INT:
+            LOGGING_FORMAT_VALUE(int);
+            break;
+
+        case LOGGING_ARG_LONG:
+            LOGGING_FORMAT_VALUE(long);
+            break;
+
+        case LOGGING_ARG_LONG_LONG:
+            LOGGING_FORMAT_VALUE(long long);
+            break;
+
+        case LOGGING_ARG_SIZE:
+            LOGGING_FORMAT_VALUE(size_t);
+            break;
+
+        case LOGGING_ARG_POINTER:
+            LOGGING_FORMAT_VALUE(void *);
+            break;
+
+        case LOGGING_ARG_DOUBLE:
+            LOGGING_FORMAT_VALUE(double);
+            break;
+
+        case LOGGING_ARG_STRING:
+            if (!tag_seen && logging_is_tag(&spec, next))
+            {
+                tag_seen = true;
+                LOGGING_FORMAT_VALUE(const char *);
+                break;
+            }
+
+            size_t string_length = strnlen((const char *)data, end - data);
+            if (string_length == (size_t)(end - data))
+                goto truncated;
+
+            written = snprintf(line + length, line_size - length, spec_format, (const char *)data);
+            data += string_length + 1;
+            break;
+
+        default:
+            logging_append(line, line_size, &length, spec.start, spec.length);
+            break;
+        }
+
+        if (written > 0)
+            length = length + written < line_size ? length + written : line_size - 1;
+    }
+
+    if (!record->truncated)
+        return length;
+
+truncated:
+    logging_append(line, line_size, &length, " [truncated]\n", strlen(" [truncated]\n"));
+    return length;
+}
+
+static void logging_append(char *line, size_t line_size, size_t *length, const char *text, size_t text_length)
+{
+    // Literal text is copied as is, except for escaped percent signs.
+    for (size_t i = 0; i < text_length && *length < line_size - 1; i++)
+    {
+        line[(*length)++] = text[i];
+
+        if (text[i] == '%' && i + 1 < text_length && text[i + 1] == '%')
+            i++;
+    }
+
+    line[*length] = '\0';
+}
+
+static const char *logging_parse_spec(const char *format, logging_spec_t *spec)
+{
+    const char *c = format;
+
+    while ((c = strchr(c, '%')) != NULL && c[1] == '%')
+        c += 2;
+
+    if (c == NULL)
+        return NULL;
+
+    spec->start = c++;
+    spec->stars = 0;
+    spec->arg = LOGGING_ARG_NONE;
+
+    while (*c && strchr("-+ #0", *c))
+        c++;
+
+    if (*c == '*')
+    {
+        spec->stars++;
+        c++;
+    }
+
+    while (isdigit((unsigned char)*c))
+        c++;
+
+    if (*c == '.')
+    {
+        c++;
+
+        if (*c == '*')
+        {
+            spec->stars++;
+            c++;
+        }
+
+        while (isdigit((unsigned char)*c))
+            c++;
+    }
+
+    uint8_t longs = 0;
+    bool size = false;
+
+    while (*c && strchr("hlLzjt", *c))
+    {
+        longs += *c == 'l';
+        longs += *c == 'j' ? 2 : 0;
+        size = size || *c == 'z' || *c == 't';
+        c++;
+    }
+
+    switch (*c)
+    {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        spec->arg = longs >= 2 ? LOGGING_ARG_LONG_LONG : longs == 1 ? LOGGING_ARG_LONG : size ? LOGGING_ARG_SIZE : LOGGING_ARG_INT;
+        break;
+
+    case 'p':
+        spec->arg = LOGGING_ARG_POINTER;
+        break;
+
+    case 's':
+        spec->arg = LOGGING_ARG_STRING;
+        break;
+
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        spec->arg = LOGGING_ARG_DOUBLE;
+        break;
+
+    default:
+        break;
+    }
+
+    if (*c)
+        c++;
+
+    spec->length = c - spec->start;
+    return c;
+}
+
+static bool logging_is_tag(const logging_spec_t *spec, const char *next)
+{
+    // ESP_LOG lines are prefixed with "<level> (<time>) <tag>: ".
+    return spec->arg == LOGGING_ARG_STRING && spec->length == 2 && next[0] == ':' && next[1] == ' ';
+}
+
+static void logging_report(char *line, size_t line_size)
+{
+    static uint32_t reported_dropped = 0;
+
+    for (uint8_t i = 0; i < CONFIG_LOGGING_RATE_TAGS; i++)
+    {
+        const char *tag = atomic_load_explicit(&rates[i].tag, memory_order_acquire);
+        uint32_t count = tag != NULL ? atomic_exchange_explicit(&rates[i].suppressed, 0, memory_order_relaxed) : 0;
+
+        if (count > 0)
+            logging_emit(line, snprintf(line, line_size, "W (%" PRIu32 ") %s: Suppressed %" PRIu32 " messages.\n", esp_log_timestamp(), tag, count));
+    }
+
+    uint32_t current_dropped = atomic_load_explicit(&dropped, memory_order_relaxed);
+    if (current_dropped != reported_dropped)
+    {
+        logging_emit(line, snprintf(line, line_size, "W (%" PRIu32 ") %s: Dropped %" PRIu32 " messages, buffer full.\n", esp_log_timestamp(), TAG, current_dropped - reported_dropped));
+        reported_dropped = current_dropped;
+    }
+}
+
+static void logging_emit(char *line, size_t length)
+{
+    if (length >= LOGGING_LINE_SIZE)
+        length = LOGGING_LINE_SIZE - 1;
+
+#ifdef CONFIG_LOGGING_UART_ENABLE
+    fwrite(line, 1, length, stdout);
+#endif
+
+    length = logging_strip(line, length);
+
+#if CONFIG_LOGGING_TAIL_SIZE > 0
+    portENTER_CRITICAL(&tail_lock);
+    for (size_t i = 0; i < length; i++)
+        tail[(tail_position + i) % CONFIG_LOGGING_TAIL_SIZE] = line[i];
+    tail_position += length;
+    portEXIT_CRITICAL(&tail_lock);
+#endif
+
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+    // Before the first connection lwIP may not even be up, lines until then only go to the other sinks.
+    if (syslog_socket < 0 && atomic_load_explicit(&is_network_connected, memory_order_relaxed))
+        syslog_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (syslog_socket < 0 || length == 0)
+        return;
+
+    uint8_t severity = line[0] == 'E' ? 3 : line[0] == 'W' ? 4 : line[0] == 'I' ? 6 : 7;
+    char message[LOGGING_LINE_SIZE + 32];
+
+    // Nil timestamp and hostname, the collector stamps the message on arrival.
+    int message_length = snprintf(message, sizeof(message), "<%u>1 - - rcs - - - %.*s", LOGGING_SYSLOG_FACILITY * 8 + severity,
+                                  (int)(line[length - 1] == '\n' ? length - 1 : length), line);
+    if (message_length > (int)sizeof(message) - 1)
+        message_length = sizeof(message) - 1;
+
+    sendto(syslog_socket, message, message_length, MSG_DONTWAIT, (struct sockaddr *)&syslog_address, sizeof(syslog_address));
+#endif
+}
+
+static size_t logging_strip(char *line, size_t length)
+{
+    size_t stripped = 0;
+
+    // Color escape sequences only make sense on the console.
+    for (size_t i = 0; i < length; i++)
+    {
+        if (line[i] == '\033')
+        {
+            while (i < length && line[i] != 'm')
+                i++;
+
+            continue;
+        }
+
+        line[stripped++] = line[i];
+    }
+
+    line[stripped] = '\0';
+    return stripped;
+}
+
+#ifdef CONFIG_LOGGING_SYSLOG_HOST
+static void logging_connect_handler()
+{
+    // The socket is created by the logging task itself, which is the only one sending on it.
+    atomic_store_explicit(&is_network_connected, true, memory_order_relaxed);
+}
+#endif
@@ -1,16 +1,24 @@
+#include "boot.h"
+#include "logging.h"
 #include "network.h"
 #include "controller.h"
 #include "http.h"
+#include "mqtt_bridge.h"
+#include "udp.h"
 #include "update.h"
 
 #include "esp_log.h"
 #include "esp_event.h"
+#include "nvs_flash.h"
 #include "driver/gpio.h"
 
 static const char *const TAG = "Main       ";
 
 void app_main()
 {
+    boot_mark("app_main");
+    logging_init();
+
     ESP_LOGI(TAG, "Raffstore Control System");
     ESP_LOGI(TAG, "Version " CONFIG_APP_PROJECT_VER);
 
@@ -20,14 +28,39 @@ void app_main()
     ESP_LOGI(TAG, "Create default event loop.");
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
-    ESP_LOGI(TAG, "Initialize network stack.");
-    network_init();
-
+    // The switches work as soon as the controller task runs, it keeps running while app_main brings up the network below.
     ESP_LOGI(TAG, "Initialize controller.");
     controller_init();
+    boot_mark("controller");
+
+    ESP_LOGI(TAG, "Initialize NVS.");
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+
+    // Devices with an older partition table have no NVS and connect without the cache.
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "NVS not available: %s", esp_err_to_name(err));
 
+    // The services register for the network events before the network can report a connection.
     ESP_LOGI(TAG, "Initialize HTTP server.");
     http_init();
 
+    ESP_LOGI(TAG, "Initialize MQTT client.");
+    mqtt_bridge_init();
+
+    ESP_LOGI(TAG, "Initialize UDP control.");
+    udp_init();
+
+    ESP_LOGI(TAG, "Initialize syslog.");
+    logging_init_syslog();
+
+    ESP_LOGI(TAG, "Initialize network stack.");
+    network_init();
+    boot_mark("network");
+
     update_mark_valid();
 }
@@ -0,0 +1,5 @@
+#pragma once
+
+void mqtt_bridge_init();
+void mqtt_bridge_start();
+void mqtt_bridge_stop();
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "mqtt_client.h"
+
+void discovery_publish(esp_mqtt_client_handle_t client, const char *node_id, const char *base_topic, const char *availability_topic);
@@ -0,0 +1,41 @@
+#include "mqtt_bridge/discovery.h"
+
+#include "config.h"
+
+#include "esp_log.h"
+#include "mqtt_client.h"
+
+#include <stdio.h>
+
+static const char *const TAG = "MQTT       : Discovery";
+
+// Home Assistant cover in abbreviated form, "~" is replaced with the channel topic.
+// Positions and angles are sent in the scale of the controller: 0 % is open, 0° is closed.
+#define COVER_CONFIG                                                                                                    \
+    "{\"name\":\"Channel %u\",\"uniq_id\":\"%s_%u\",\"~\":\"%s/%u\",\"avty_t\":\"%s\",\"dev_cla\":\"blind\",\"qos\":%d,"         \
+    "\"cmd_t\":\"~/set\",\"stat_t\":\"~/state\","                                                                              \
+    "\"pos_t\":\"~/position\",\"set_pos_t\":\"~/position/set\",\"pos_open\":0,\"pos_clsd\":100,"                               \
+    "\"tilt_status_t\":\"~/tilt\",\"tilt_cmd_t\":\"~/tilt/set\",\"tilt_min\":0,\"tilt_max\":90,"                               \
+    "\"tilt_clsd_val\":0,\"tilt_opnd_val\":90,"                                                                                \
+    "\"dev\":{\"ids\":[\"%s\"],\"name\":\"%s\",\"mdl\":\"Raffstore Control System\",\"sw\":\"" CONFIG_APP_PROJECT_VER "\"}}"
+
+void discovery_publish(esp_mqtt_client_handle_t client, const char *node_id, const char *base_topic, const char *availability_topic)
+{
+    char topic[96];
+    char payload[768];
+
+    for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+    {
+        snprintf(topic, sizeof(topic), CONFIG_MQTT_DISCOVERY_PREFIX "/cover/%s/%u/config", node_id, i);
+        int length = snprintf(payload, sizeof(payload), COVER_CONFIG, i, node_id, i, base_topic, i, availability_topic, CONFIG_MQTT_QOS, node_id, node_id);
+
+        if (length < 0 || length >= sizeof(payload))
+        {
+            ESP_LOGE(TAG, "Discovery payload of channel %u too long.", i);
+            continue;
+        }
+
+        if (esp_mqtt_client_enqueue(client, topic, payload, length, CONFIG_MQTT_QOS, 1, true) < 0)
+            ESP_LOGW(TAG, "Failed to queue discovery payload of channel %u.", i);
+    }
+}
@@ -0,0 +1,280 @@
+#include "mqtt_bridge.h"
+#include "mqtt_bridge/discovery.h"
+
+#include "config.h"
+#include "controller.h"
+#include "network.h"
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "mqtt_client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *const TAG = "MQTT       ";
+
+static const char *const COMMAND_TOPICS[] = {"+/set", "+/position/set", "+/tilt/set"};
+
+static esp_mqtt_client_handle_t client = NULL;
+static volatile bool is_running = false;
+static volatile bool is_connected = false;
+
+static char node_id[32];
+static char base_topic[64];
+static char availability_topic[80];
+
+static void mqtt_event_handler(void *, esp_event_base_t, int32_t, void *);
+static void controller_event_handler(void *, esp_event_base_t, int32_t, void *);
+
+static void mqtt_bridge_publish(const char *, const char *);
+static void mqtt_bridge_publish_channel(uint8_t, const controller_channel_state_t *);
+static void mqtt_bridge_command(const char *, size_t, const char *, size_t);
+
+void mqtt_bridge_init()
+{
+#ifndef CONFIG_MQTT_BROKER_URI
+    ESP_LOGI(TAG, "No broker configured.");
+#else
+#ifdef CONFIG_MQTT_NODE_ID
+    snprintf(node_id, sizeof(node_id), "%s", CONFIG_MQTT_NODE_ID);
+#else
+    // Every device of the fleet needs its own topics, so the default node id is made from the MAC address.
+    uint8_t mac_addr[8];
+    ESP_ERROR_CHECK(esp_read_mac(mac_addr, ESP_MAC_WIFI_STA));
+    snprintf(node_id, sizeof(node_id), "rcs-%02x%02x%02x", mac_addr[3], mac_addr[4], mac_addr[5]);
+#endif
+
+    snprintf(base_topic, sizeof(base_topic), CONFIG_MQTT_TOPIC_PREFIX "/%s", node_id);
+    snprintf(availability_topic, sizeof(availability_topic), "%s/status", base_topic);
+
+    ESP_LOGI(TAG, "Create client \"%s\".", node_id);
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .uri = CONFIG_MQTT_BROKER_URI,
+        .client_id = node_id,
+#ifdef CONFIG_MQTT_USERNAME
+        .username = CONFIG_MQTT_USERNAME,
+        .password = CONFIG_MQTT_PASSWORD,
+#endif
+        .keepalive = CONFIG_MQTT_KEEPALIVE_SEC,
+        .lwt_topic = availability_topic,
+        .lwt_msg = "offline",
+        .lwt_qos = CONFIG_MQTT_QOS,
+        .lwt_retain = 1,
+    };
+
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    if (client == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create client.");
+        return;
+    }
+
+    ESP_ERROR_CHECK(esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, &mqtt_event_handler, NULL));
+    ESP_ERROR_CHECK(controller_register_event_handler(&controller_event_handler, NULL));
+
+    ESP_LOGI(TAG, "Register network handlers.");
+    network_register_connect_handler(&mqtt_bridge_start);
+    network_register_disconnect_handler(&mqtt_bridge_stop);
+#endif
+}
+
+void mqtt_bridge_start()
+{
+    if (client == NULL || is_running)
+        return;
+
+    ESP_LOGI(TAG, "Starting...");
+
+    if (esp_mqtt_client_start(client) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start client.");
+        return;
+    }
+
+    is_running = true;
+}
+
+void mqtt_bridge_stop()
+{
+    if (client == NULL || !is_running)
+        return;
+
+    ESP_LOGI(TAG, "Stopping...");
+
+    if (esp_mqtt_client_stop(client) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to stop client.");
+        return;
+    }
+
+    is_running = false;
+    is_connected = false;
+    ESP_LOGI(TAG, "Stopped!");
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    esp_mqtt_event_handle_t event = data;
+
+    switch (id)
+    {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected!");
+        is_connected = true;
+
+        char topic[96];
+        for (uint8_t i = 0; i < sizeof(COMMAND_TOPICS) / sizeof(COMMAND_TOPICS[0]); i++)
+        {
+            snprintf(topic, sizeof(topic), "%s/%s", base_topic, COMMAND_TOPICS[i]);
+            if (esp_mqtt_client_subscribe(client, topic, CONFIG_MQTT_QOS) < 0)
+                ESP_LOGW(TAG, "Failed to subscribe to \"%s\".", topic);
+        }
+
+        mqtt_bridge_publish(availability_topic, "online");
+        discovery_publish(client, node_id, base_topic, availability_topic);
+
+        // The retained state may be outdated after a reconnect, so all channels are published again.
+        controller_snapshot_t snapshot;
+        controller_query_all(&snapshot);
+
+        for (uint8_t i = 0; i < CONFIG_CONTROLLER_CHANNEL_NUM; i++)
+            mqtt_bridge_publish_channel(i, &snapshot.channels[i]);
+        break;
+
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGI(TAG, "Disconnected!");
+        is_connected = false;
+        break;
+
+    case MQTT_EVENT_DATA:
+        // Commands are short, anything split over several events is not one of them.
+        if (event->current_data_offset != 0 || event->data_len != event->total_data_len)
+            break;
+
+        mqtt_bridge_command(event->topic, event->topic_len, event->data, event->data_len);
+        break;
+
+    case MQTT_EVENT_ERROR:
+        ESP_LOGW(TAG, "Connection error.");
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void controller_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (!is_connected)
+        return;
+
+    controller_event_data_t *event_data = data;
+    controller_snapshot_t snapshot;
+    controller_query_all(&snapshot);
+
+    mqtt_bridge_publish_channel(event_data->channel_num, &snapshot.channels[event_data->channel_num]);
+}
+
+static void mqtt_bridge_publish(const char *topic, const char *payload)
+{
+    // Queued messages are sent by the client task, so the event loop never waits for the broker.
+    if (esp_mqtt_client_enqueue(client, topic, payload, 0, CONFIG_MQTT_QOS, 1, true) < 0)
+        ESP_LOGW(TAG, "Failed to queue message for \"%s\".", topic);
+}
+
+static void mqtt_bridge_publish_channel(uint8_t channel_num, const controller_channel_state_t *state)
+{
+    char topic[96];
+    char value[8];
+
+    const char *state_name;
+    if (state->running == CHANNEL_EVENT_OPEN)
+        state_name = "opening";
+    else if (state->running == CHANNEL_EVENT_CLOSE)
+        state_name = "closing";
+    else if (state->position == 0)
+        state_name = "open";
+    else if (state->position == 100)
+        state_name = "closed";
+    else
+        state_name = "stopped";
+
+    snprintf(topic, sizeof(topic), "%s/%u/state", base_topic, channel_num);
+    mqtt_bridge_publish(topic, state_name);
+
+    // Unknown positions and angles after booting are not published, the retained values stay in place.
+    if (state->position >= 0)
+    {
+        snprintf(topic, sizeof(topic), "%s/%u/position", base_topic, channel_num);
+        snprintf(value, sizeof(value), "%d", state->position);
+        mqtt_bridge_publish(topic, value);
+    }
+
+    if (state->tilt >= 0)
+    {
+        snprintf(topic, sizeof(topic), "%s/%u/tilt", base_topic, channel_num);
+        snprintf(value, sizeof(value), "%d", state->tilt);
+        mqtt_bridge_publish(topic, value);
+    }
+}
+
+static void mqtt_bridge_command(const char *topic, size_t topic_len, const char *data, size_t data_len)
+{
+    size_t base_len = strlen(base_topic);
+    if (topic_len <= base_len + 1 || strncmp(topic, base_topic, base_len) != 0 || topic[base_len] != '/')
+        return;
+
+    // Topic and payload are not terminated.
+    char path[32];
+    char payload[16];
+    if (topic_len - base_len - 1 >= sizeof(path) || data_len >= sizeof(payload))
+        return;
+
+    memcpy(path, topic + base_len + 1, topic_len - base_len - 1);
+    path[topic_len - base_len - 1] = '\0';
+    memcpy(payload, data, data_len);
+    payload[data_len] = '\0';
+
+    ESP_LOGI(TAG, "Received \"%s\" at \"%s\".", payload, path);
+
+    char *end;
+    uint64_t channel = strtoul(path, &end, 10);
+    if (end == path || channel >= CONFIG_CONTROLLER_CHANNEL_NUM)
+    {
+        ESP_LOGW(TAG, "Invalid channel in \"%s\".", path);
+        return;
+    }
+
+    esp_err_t err;
+    if (!strcmp(end, "/set"))
+    {
+        if (!strcasecmp(payload, "OPEN"))
+            err = controller_open(channel, true);
+        else if (!strcasecmp(payload, "CLOSE"))
+            err = controller_close(channel, true);
+        else if (!strcasecmp(payload, "STOP"))
+            err = controller_stop(channel, true);
+        else
+            err = ESP_ERR_INVALID_ARG;
+    }
+    else
+    {
+        char *value_end;
+        uint64_t value = strtoul(payload, &value_end, 10);
+
+        if (value_end == payload || *value_end)
+            err = ESP_ERR_INVALID_ARG;
+        else if (!strcmp(end, "/position/set"))
+            err = value <= 100 ? controller_move(channel, value, true) : ESP_ERR_INVALID_ARG;
+        else if (!strcmp(end, "/tilt/set"))
+            err = value <= 90 ? controller_tilt(channel, value, true) : ESP_ERR_INVALID_ARG;
+        else
+            err = ESP_ERR_NOT_FOUND;
+    }
+
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Command \"%s\" at \"%s\" failed: %s", payload, path, esp_err_to_name(err));
+}
@@ -2,9 +2,37 @@
 
 #include "esp_err.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef void connection_handler_func();
 
+typedef enum network_interface
+{
+    NETWORK_INTERFACE_ETHERNET,
+    NETWORK_INTERFACE_WIFI,
+    NETWORK_INTERFACE_NUM,
+} network_interface_t;
+
+typedef struct network_interface_state
+{
+    bool link_up;
+    bool connected;
+} network_interface_state_t;
+
+typedef struct network_failover_stats
+{
+    bool active;
+    uint32_t failovers;
+    uint32_t last_duration_us;
+    uint32_t max_duration_us;
+} network_failover_stats_t;
+
 void network_init();
 
 esp_err_t network_register_connect_handler(connection_handler_func *on_connect);
 esp_err_t network_register_disconnect_handler(connection_handler_func *on_disconnect);
+
+void network_query_state(network_interface_t interface, network_interface_state_t *state_out);
+void network_query_failover_stats(network_failover_stats_t *stats_out);
+int64_t network_query_online_time();
@@ -1,5 +1,7 @@
 #pragma once
 
-void ethernet_init();
+#include "esp_netif.h"
+
+esp_netif_t *ethernet_init();
 void ethernet_start();
 void ethernet_stop();
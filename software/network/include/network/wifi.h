@@ -1,5 +1,10 @@
 #pragma once
 
-void wifi_init();
+#include "esp_netif.h"
+
+#include <stdbool.h>
+
+esp_netif_t *wifi_init();
 void wifi_start();
 void wifi_stop();
+void wifi_set_standby(bool standby);
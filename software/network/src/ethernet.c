@@ -9,12 +9,16 @@
 
 static const char *const TAG = "Network    : Ethernet ";
 
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+_Static_assert(CONFIG_ETHERNET_MAC_ADDRESS != ESP_MAC_WIFI_STA, "Ethernet and Wi-Fi are up at the same time and need different MAC addresses.");
+#endif
+
 static esp_eth_handle_t eth_handle;
 static volatile bool is_running = false;
 
 static void ethernet_handler(void *, esp_event_base_t, int32_t, void *);
 
-void ethernet_init()
+esp_netif_t *ethernet_init()
 {
     ESP_LOGI(TAG, "Initialize SPI bus.");
     spi_bus_config_t spi_bus_cfg = {
@@ -51,6 +55,7 @@ void ethernet_init()
     esp_eth_phy_t *eth_phy = esp_eth_phy_new_w5500(&phy_cfg);
 
     esp_eth_config_t eth_cfg = ETH_DEFAULT_CONFIG(eth_mac, eth_phy);
+    eth_cfg.check_link_period_ms = CONFIG_ETHERNET_LINK_CHECK_MS; // the W5500 link state is polled
     ESP_ERROR_CHECK(esp_eth_driver_install(&eth_cfg, &eth_handle));
 
     ESP_LOGI(TAG, "Set MAC address.");
@@ -60,6 +65,7 @@ void ethernet_init()
 
     ESP_LOGI(TAG, "Attach driver to network stack.");
     esp_netif_inherent_config_t netif_base_cfg = ESP_NETIF_INHERENT_DEFAULT_ETH();
+    netif_base_cfg.route_prio = CONFIG_ETHERNET_ROUTE_PRIO;
     esp_netif_config_t netif_cfg = {
         .base = &netif_base_cfg,
         .stack = ESP_NETIF_NETSTACK_DEFAULT_ETH,
@@ -69,6 +75,8 @@ void ethernet_init()
     ESP_ERROR_CHECK(esp_netif_attach(eth_netif, esp_eth_new_netif_glue(eth_handle)));
 
     ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ESP_EVENT_ANY_ID, &ethernet_handler, NULL, NULL));
+
+    return eth_netif;
 }
 
 void ethernet_start()
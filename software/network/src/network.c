@@ -3,11 +3,13 @@
 #include "network/ethernet.h"
 #include "network/wifi.h"
 
+#include "boot.h"
 #include "config.h"
 
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 
@@ -20,11 +22,31 @@ enum
 
 static const char *const TAG = "Network    ";
 
+// Only written from the event loop task.
+static network_interface_state_t interface_states[NETWORK_INTERFACE_NUM];
+static esp_netif_t *interface_netifs[NETWORK_INTERFACE_NUM];
+static network_failover_stats_t failover_stats;
+static int64_t online_time_us;
+
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+static int64_t failover_start_us;
+#endif
+
 static void event_handler_helper(void *, esp_event_base_t, int32_t, void *);
 static void network_event_handler(void *, esp_event_base_t, int32_t, void *);
+static void state_event_handler(void *, esp_event_base_t, int32_t, void *);
 
+#if defined(CONFIG_ETHERNET_STATIC_IP) || defined(CONFIG_WIFI_STATIC_IP)
+static void static_ip_set(esp_netif_t *, const char *, const char *, const char *, const char *);
+#endif
+
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+static void failover_handler(void *, esp_event_base_t, int32_t, void *);
+static void failover_route(network_interface_t);
+#else
 static void ethernet_handler(void *, esp_event_base_t, int32_t, void *);
 static void fallback_timer_handler(TimerHandle_t);
+#endif
 
 void network_init()
 {
@@ -32,23 +54,51 @@ void network_init()
     ESP_ERROR_CHECK(esp_netif_init());
 
     ESP_LOGI(TAG, "Initialize Ethernet driver.");
-    ethernet_init();
+    interface_netifs[NETWORK_INTERFACE_ETHERNET] = ethernet_init();
 
     ESP_LOGI(TAG, "Initialize Wi-Fi driver.");
-    wifi_init();
+    interface_netifs[NETWORK_INTERFACE_WIFI] = wifi_init();
+
+#ifdef CONFIG_ETHERNET_STATIC_IP
+    ESP_LOGI(TAG, "Set static Ethernet address.");
+    static_ip_set(interface_netifs[NETWORK_INTERFACE_ETHERNET], CONFIG_ETHERNET_STATIC_IP, CONFIG_ETHERNET_STATIC_NETMASK, CONFIG_ETHERNET_STATIC_GATEWAY, CONFIG_ETHERNET_STATIC_DNS);
+#endif
 
+#ifdef CONFIG_WIFI_STATIC_IP
+    ESP_LOGI(TAG, "Set static Wi-Fi address.");
+    static_ip_set(interface_netifs[NETWORK_INTERFACE_WIFI], CONFIG_WIFI_STATIC_IP, CONFIG_WIFI_STATIC_NETMASK, CONFIG_WIFI_STATIC_GATEWAY, CONFIG_WIFI_STATIC_DNS);
+#endif
+
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+    ESP_LOGI(TAG, "Register failover events.");
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &failover_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_ETH_GOT_IP, &failover_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &failover_handler, NULL, NULL));
+#else
     ESP_LOGI(TAG, "Create fallback timer.");
     TimerHandle_t fallback_timer = xTimerCreate("network_fallback", CONFIG_NETWORK_FALLBACK_TIMEOUT_SEC * 1000 / portTICK_PERIOD_MS, pdFALSE, NULL, &fallback_timer_handler);
     ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ESP_EVENT_ANY_ID, &ethernet_handler, fallback_timer, NULL));
+#endif
 
     ESP_LOGI(TAG, "Register network events.");
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &network_event_handler, NULL, NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ETHERNET_EVENT_DISCONNECTED, &network_event_handler, NULL, NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &network_event_handler, NULL, NULL));
 
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(ETH_EVENT, ESP_EVENT_ANY_ID, &state_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &state_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &state_event_handler, NULL, NULL));
+
     ESP_LOGI(TAG, "Start network.");
     ethernet_start();
+
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+    // Wi-Fi associates right away and idles in power save until the Ethernet link is lost.
+    wifi_start();
+    wifi_set_standby(true);
+#else
     xTimerStart(fallback_timer, 0);
+#endif
 }
 
 esp_err_t network_register_connect_handler(connection_handler_func *on_connect)
@@ -61,6 +111,21 @@ esp_err_t network_register_disconnect_handler(connection_handler_func *on_discon
     return esp_event_handler_instance_register(NETWORK_EVENT, NETWORK_EVENT_DISCONNECTED, &event_handler_helper, on_disconnect, NULL);
 }
 
+void network_query_state(network_interface_t interface, network_interface_state_t *state_out)
+{
+    *state_out = interface_states[interface];
+}
+
+void network_query_failover_stats(network_failover_stats_t *stats_out)
+{
+    *stats_out = failover_stats;
+}
+
+int64_t network_query_online_time()
+{
+    return online_time_us;
+}
+
 static void event_handler_helper(void *arg, esp_event_base_t base, int32_t id, void *data)
 {
     (*(connection_handler_func *)arg)();
@@ -75,9 +140,15 @@ static void network_event_handler(void *arg, esp_event_base_t base, int32_t id,
         esp_event_post(NETWORK_EVENT, NETWORK_EVENT_CONNECTED, NULL, 0, 0);
         break;
 
+    // The services keep running as long as the other interface is still connected.
     case ETHERNET_EVENT_DISCONNECTED:
+        if (!interface_states[NETWORK_INTERFACE_WIFI].connected)
+            esp_event_post(NETWORK_EVENT, NETWORK_EVENT_DISCONNECTED, NULL, 0, 0);
+        break;
+
     case WIFI_EVENT_STA_DISCONNECTED:
-        esp_event_post(NETWORK_EVENT, NETWORK_EVENT_DISCONNECTED, NULL, 0, 0);
+        if (!interface_states[NETWORK_INTERFACE_ETHERNET].connected)
+            esp_event_post(NETWORK_EVENT, NETWORK_EVENT_DISCONNECTED, NULL, 0, 0);
         break;
 
     default:
@@ -85,6 +156,100 @@ static void network_event_handler(void *arg, esp_event_base_t base, int32_t id,
     }
 }
 
+static void state_event_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    network_interface_state_t *ethernet = &interface_states[NETWORK_INTERFACE_ETHERNET];
+    network_interface_state_t *wifi = &interface_states[NETWORK_INTERFACE_WIFI];
+
+    if (base == ETH_EVENT && id == ETHERNET_EVENT_CONNECTED)
+        ethernet->link_up = true;
+    else if (base == ETH_EVENT && (id == ETHERNET_EVENT_DISCONNECTED || id == ETHERNET_EVENT_STOP))
+        *ethernet = (network_interface_state_t){0};
+    else if (base == WIFI_EVENT && id == WIFI_EVENT_STA_CONNECTED)
+        wifi->link_up = true;
+    else if (base == WIFI_EVENT && (id == WIFI_EVENT_STA_DISCONNECTED || id == WIFI_EVENT_STA_STOP))
+        *wifi = (network_interface_state_t){0};
+    else if (base == IP_EVENT && id == IP_EVENT_ETH_GOT_IP)
+        ethernet->connected = true;
+    else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+        wifi->connected = true;
+    else if (base == IP_EVENT && id == IP_EVENT_STA_LOST_IP)
+        wifi->connected = false;
+
+    if (online_time_us == 0 && (ethernet->connected || wifi->connected))
+    {
+        online_time_us = esp_timer_get_time();
+        boot_mark("online");
+    }
+}
+
+#if defined(CONFIG_ETHERNET_STATIC_IP) || defined(CONFIG_WIFI_STATIC_IP)
+static void static_ip_set(esp_netif_t *netif, const char *ip, const char *netmask, const char *gateway, const char *dns)
+{
+    // Without a DHCP client the address is applied and reported as soon as the link is up.
+    esp_netif_dhcpc_stop(netif);
+
+    esp_netif_ip_info_t ip_info = {
+        .ip.addr = esp_ip4addr_aton(ip),
+        .netmask.addr = esp_ip4addr_aton(netmask),
+        .gw.addr = esp_ip4addr_aton(gateway),
+    };
+
+    ESP_ERROR_CHECK(esp_netif_set_ip_info(netif, &ip_info));
+
+    esp_netif_dns_info_t dns_info = {
+        .ip.u_addr.ip4.addr = esp_ip4addr_aton(dns),
+        .ip.type = ESP_IPADDR_TYPE_V4,
+    };
+
+    ESP_ERROR_CHECK(esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns_info));
+}
+#endif
+
+#ifdef CONFIG_NETWORK_FAILOVER_ENABLE
+static void failover_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (base == ETH_EVENT && id == ETHERNET_EVENT_DISCONNECTED)
+    {
+        ESP_LOGW(TAG, "Ethernet link lost, failing over to Wi-Fi.");
+        failover_start_us = esp_timer_get_time();
+        wifi_set_standby(false);
+
+        // Without a standby connection the route is switched once Wi-Fi got its address.
+        if (interface_states[NETWORK_INTERFACE_WIFI].connected)
+            failover_route(NETWORK_INTERFACE_WIFI);
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP && !interface_states[NETWORK_INTERFACE_ETHERNET].connected)
+    {
+        failover_route(NETWORK_INTERFACE_WIFI);
+    }
+    else if (base == IP_EVENT && id == IP_EVENT_ETH_GOT_IP)
+    {
+        ESP_LOGI(TAG, "Ethernet connected, Wi-Fi back to standby.");
+        failover_route(NETWORK_INTERFACE_ETHERNET);
+        wifi_set_standby(true);
+    }
+}
+
+static void failover_route(network_interface_t interface)
+{
+    esp_netif_set_default_netif(interface_netifs[interface]);
+    failover_stats.active = interface == NETWORK_INTERFACE_WIFI;
+
+    if (interface != NETWORK_INTERFACE_WIFI || failover_start_us == 0)
+        return;
+
+    uint32_t duration = esp_timer_get_time() - failover_start_us;
+    failover_start_us = 0;
+
+    failover_stats.failovers++;
+    failover_stats.last_duration_us = duration;
+    if (duration > failover_stats.max_duration_us)
+        failover_stats.max_duration_us = duration;
+
+    ESP_LOGW(TAG, "Failed over to Wi-Fi in %" PRIu32 " us (max %" PRIu32 " us).", duration, failover_stats.max_duration_us);
+}
+#else
 static void ethernet_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
 {
     switch (id)
@@ -112,3 +277,4 @@ static void fallback_timer_handler(TimerHandle_t timer)
     ESP_LOGI(TAG, "Wi-Fi fallback timeout reached.");
     wifi_start();
 }
+#endif
@@ -5,17 +5,36 @@
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_wifi.h"
+#include "nvs.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/timers.h"
 
 static const char *const TAG = "Network    : Wi-Fi    ";
 
+#define WIFI_CACHE_NAMESPACE "network"
+#define WIFI_CACHE_KEY "wifi_ap"
+
+// Access point of the last connection, which is joined again without scanning all channels.
+typedef struct wifi_cache
+{
+    uint8_t bssid[6];
+    uint8_t channel;
+} wifi_cache_t;
+
 static volatile bool is_running = false;
 
+static wifi_cache_t cache;
+static bool is_cache_locked = false;
+static bool is_connected = false;
+
 static void wifi_handler(void *, esp_event_base_t, int32_t, void *);
 static void reconnect_timer_handler(TimerHandle_t);
 
-void wifi_init()
+static bool wifi_cache_load(wifi_cache_t *);
+static void wifi_cache_store(const wifi_cache_t *);
+static void wifi_cache_unlock();
+
+esp_netif_t *wifi_init()
 {
     ESP_LOGI(TAG, "Install Wi-Fi driver.");
     wifi_init_config_t init_cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -28,17 +47,29 @@ void wifi_init()
             .ssid = CONFIG_WIFI_SSID,
             .password = CONFIG_WIFI_PASSPHRASE,
             .threshold.authmode = CONFIG_WIFI_AUTHENTICATION,
+            .listen_interval = CONFIG_WIFI_STANDBY_LISTEN_INTERVAL,
         },
     };
 
+    if (wifi_cache_load(&cache))
+    {
+        ESP_LOGI(TAG, "Use cached access point on channel %u.", cache.channel);
+        wifi_cfg.sta.bssid_set = true;
+        memcpy(wifi_cfg.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        wifi_cfg.sta.channel = cache.channel;
+        is_cache_locked = true;
+    }
+
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg));
 
     ESP_LOGI(TAG, "Attach driver to network stack.");
-    esp_netif_create_default_wifi_sta();
+    esp_netif_t *wifi_netif = esp_netif_create_default_wifi_sta();
 
     ESP_LOGI(TAG, "Create reconnect timer.");
     TimerHandle_t reconnect_timer = xTimerCreate("wifi_reconnect", CONFIG_WIFI_RECONNECT_TIMEOUT_SEC * 1000 / portTICK_PERIOD_MS, pdFALSE, NULL, &reconnect_timer_handler);
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_handler, reconnect_timer, NULL));
+
+    return wifi_netif;
 }
 
 void wifi_start()
@@ -61,6 +92,21 @@ void wifi_stop()
     }
 }
 
+void wifi_set_standby(bool standby)
+{
+    // The listen interval only applies to the maximum power save mode, so the standby only wakes up for every n-th beacon.
+    if (standby)
+    {
+        ESP_LOGI(TAG, "Entering standby.");
+        esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Leaving standby.");
+        esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+    }
+}
+
 static void wifi_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
 {
     switch (id)
@@ -74,15 +120,41 @@ static void wifi_handler(void *arg, esp_event_base_t base, int32_t id, void *dat
     case WIFI_EVENT_STA_STOP:
         ESP_LOGI(TAG, "Stopped!");
         xTimerStop((TimerHandle_t)arg, 0);
+        is_connected = false;
         break;
 
-    case WIFI_EVENT_STA_CONNECTED:
+    case WIFI_EVENT_STA_CONNECTED:;
         ESP_LOGI(TAG, "Connected!");
         xTimerStop((TimerHandle_t)arg, 0);
+        is_connected = true;
+
+        wifi_event_sta_connected_t *connected = data;
+        if (memcmp(cache.bssid, connected->bssid, sizeof(cache.bssid)) != 0 || cache.channel != connected->channel)
+        {
+            memcpy(cache.bssid, connected->bssid, sizeof(cache.bssid));
+            cache.channel = connected->channel;
+            wifi_cache_store(&cache);
+        }
         break;
 
     case WIFI_EVENT_STA_DISCONNECTED:
         ESP_LOGI(TAG, "Disconnected!");
+
+        // Reconnects scan again, so the station can move to another access point.
+        if (is_cache_locked)
+        {
+            wifi_cache_unlock();
+
+            // A cached access point that cannot be joined is skipped right away instead of after the timeout.
+            if (!is_connected && is_running)
+            {
+                ESP_LOGW(TAG, "Cached access point not reachable, scanning.");
+                esp_wifi_connect();
+                break;
+            }
+        }
+
+        is_connected = false;
         xTimerReset((TimerHandle_t)arg, 0);
         break;
 
@@ -101,3 +173,51 @@ static void reconnect_timer_handler(TimerHandle_t timer)
         esp_wifi_connect();
     }
 }
+
+static bool wifi_cache_load(wifi_cache_t *cache_out)
+{
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+
+    size_t length = sizeof(*cache_out);
+    esp_err_t err = nvs_get_blob(handle, WIFI_CACHE_KEY, cache_out, &length);
+    nvs_close(handle);
+
+    return err == ESP_OK && length == sizeof(*cache_out) && cache_out->channel != 0;
+}
+
+static void wifi_cache_store(const wifi_cache_t *cache)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Cannot cache access point: %s", esp_err_to_name(err));
+        return;
+    }
+
+    err = nvs_set_blob(handle, WIFI_CACHE_KEY, cache, sizeof(*cache));
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+
+    nvs_close(handle);
+
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Cannot cache access point: %s", esp_err_to_name(err));
+    else
+        ESP_LOGI(TAG, "Cached access point on channel %u.", cache->channel);
+}
+
+static void wifi_cache_unlock()
+{
+    wifi_config_t wifi_cfg;
+    if (esp_wifi_get_config(WIFI_IF_STA, &wifi_cfg) != ESP_OK)
+        return;
+
+    wifi_cfg.sta.bssid_set = false;
+    wifi_cfg.sta.channel = 0;
+
+    if (esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg) == ESP_OK)
+        is_cache_locked = false;
+}
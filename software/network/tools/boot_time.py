@@ -0,0 +1,79 @@
+"""Reset a device repeatedly and report the time from boot to its first address and first HTTP response.
+
+The device is reset through the RTS line of its USB serial adapter, like esptool does, and /status/boot is
+polled until it answers. That answer is the first handled request of the boot, it is recorded as the
+`first_response` stage once sent, so the stages are read with a second request. `online` and
+`first_response` are the times to compare before and after a network change.
+
+    python boot_time.py --port /dev/ttyUSB0 --host 192.168.1.50 --runs 20
+"""
+
+import argparse
+import json
+import statistics
+import time
+import urllib.request
+
+import serial
+
+
+def reset(port):
+    with serial.Serial(port) as device:
+        device.dtr = False
+        device.rts = True
+        time.sleep(0.1)
+        device.rts = False
+
+
+def query_stages(host):
+    with urllib.request.urlopen(f"http://{host}/status/boot", timeout=0.5) as response:
+        return {stage["stage"]: stage["time_us"] / 1e6 for stage in json.load(response)}
+
+
+def wait_stages(host, timeout):
+    deadline = time.monotonic() + timeout
+
+    while time.monotonic() < deadline:
+        try:
+            query_stages(host)
+            return query_stages(host)
+        except OSError:
+            time.sleep(0.05)
+
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", required=True, help="serial port of the device")
+    parser.add_argument("--host", required=True, help="address of the device")
+    parser.add_argument("--runs", type=int, default=10)
+    parser.add_argument("--timeout", type=float, default=60, help="seconds to wait for a response after a reset")
+    args = parser.parse_args()
+
+    results = {"online": [], "first_response": []}
+
+    for run in range(args.runs):
+        reset(args.port)
+        # The device still answers for a moment until the reset took effect.
+        time.sleep(0.5)
+
+        stages = wait_stages(args.host, args.timeout)
+        if stages is None:
+            print(f"run {run + 1}: no response")
+            continue
+
+        print(f"run {run + 1}: online {stages.get('online', 0):.3f} s, first response {stages.get('first_response', 0):.3f} s")
+        for name in results:
+            if name in stages:
+                results[name].append(stages[name])
+
+    for name, times in results.items():
+        if times:
+            print(f"{name}: median {statistics.median(times):.3f} s, min {min(times):.3f} s, max {max(times):.3f} s over {len(times)} runs")
+
+    return 0 if results["first_response"] else 1
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,4 @@
+#pragma once
+
+void udp_init();
+void udp_start();
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+#define UDP_PROTOCOL_MAGIC "RC"
+#define UDP_PROTOCOL_VERSION 2
+
+#define UDP_OPCODE_ACK 0x80
+#define UDP_TAG_SIZE 16
+
+typedef enum udp_status
+{
+    UDP_STATUS_OK,
+    UDP_STATUS_INVALID,
+    UDP_STATUS_REJECTED,
+    UDP_STATUS_EXPIRED,
+} udp_status_t;
+
+// All fields are little endian. Commands carry a channel_event_t as opcode and the time they were sent as
+// microseconds since the Unix epoch, acks the same opcode with UDP_OPCODE_ACK set, the timestamp of the
+// command and the accepted channels. The tag is the truncated HMAC-SHA256 of all preceding bytes.
+typedef struct __attribute__((packed)) udp_packet
+{
+    char magic[2];
+    uint8_t version;
+    uint8_t opcode;
+    uint32_t channels;
+    uint64_t timestamp;
+    uint8_t value;
+    uint8_t status;
+    uint8_t reserved[2];
+    uint8_t tag[UDP_TAG_SIZE];
+} udp_packet_t;
+
+_Static_assert(sizeof(udp_packet_t) == 36, "udp_packet_t must match the wire format.");
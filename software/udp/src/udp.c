@@ -0,0 +1,316 @@
+#include "udp.h"
+#include "udp/protocol.h"
+
+#include "config.h"
+#include "controller.h"
+#include "network.h"
+
+#include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *const TAG = "UDP        ";
+
+// Commands signed with a key known from the repository would be accepted by every device built from it.
+_Static_assert(sizeof(CONFIG_UDP_KEY) > 16, "CONFIG_UDP_KEY needs at least 16 characters, set CONFIG_SECRET_UDP_KEY in config/secrets.h.");
+
+#define UDP_REPLAY_WINDOW_US (CONFIG_UDP_REPLAY_WINDOW_MS * 1000LL)
+
+static const char *const MULTICAST_GROUPS[] = {
+#ifdef CONFIG_UDP_MULTICAST_GROUP0
+    CONFIG_UDP_MULTICAST_GROUP0,
+#endif
+#ifdef CONFIG_UDP_MULTICAST_GROUP1
+    CONFIG_UDP_MULTICAST_GROUP1,
+#endif
+#ifdef CONFIG_UDP_MULTICAST_GROUP2
+    CONFIG_UDP_MULTICAST_GROUP2,
+#endif
+#ifdef CONFIG_UDP_MULTICAST_GROUP3
+    CONFIG_UDP_MULTICAST_GROUP3,
+#endif
+    NULL,
+};
+
+// Commands that ran within the replay window, looked up by their tag to answer retransmissions without
+// running them again. An entry can be reused once its command is outside the window and would be dropped anyway.
+typedef struct udp_replay_entry
+{
+    uint8_t tag[UDP_TAG_SIZE];
+    int64_t timestamp;
+    uint32_t accepted;
+    udp_status_t status;
+} udp_replay_entry_t;
+
+static TaskHandle_t server_task = NULL;
+static volatile int server_socket = -1;
+static volatile bool is_time_synced = false;
+
+static udp_replay_entry_t replay_cache[CONFIG_UDP_REPLAY_CACHE_SIZE];
+
+static void udp_server_task(void *);
+static void udp_join_groups();
+static void udp_handle(udp_packet_t *, const struct sockaddr_in *);
+static void udp_time_sync_handler(struct timeval *);
+
+static udp_status_t udp_check_time(int64_t, int64_t *);
+static udp_replay_entry_t *udp_find_replay(const udp_packet_t *, int64_t, bool *);
+static void udp_sign(const udp_packet_t *, uint8_t[UDP_TAG_SIZE]);
+static bool udp_verify(const udp_packet_t *);
+
+void udp_init()
+{
+    ESP_LOGI(TAG, "Register network handlers.");
+    network_register_connect_handler(&udp_start);
+}
+
+void udp_start()
+{
+    // The socket outlives connection losses, only the group memberships are renewed for the current interface.
+    if (server_task != NULL)
+    {
+        udp_join_groups();
+        return;
+    }
+
+    ESP_LOGI(TAG, "Starting...");
+
+    // Commands are only accepted within the replay window around the current time, which needs a synchronized clock.
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_UDP_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(&udp_time_sync_handler);
+    sntp_init();
+
+    if (xTaskCreate(&udp_server_task, "udp", CONFIG_UDP_TASK_STACK_SIZE, NULL, CONFIG_UDP_TASK_PRIORITY, &server_task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create server task.");
+        server_task = NULL;
+    }
+}
+
+static void udp_server_task(void *arg)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "Failed to create socket: %d", errno);
+        server_task = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        ESP_LOGE(TAG, "Failed to bind port %u: %d", CONFIG_UDP_PORT, errno);
+        close(fd);
+        server_task = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    server_socket = fd;
+    udp_join_groups();
+
+    ESP_LOGI(TAG, "Started on port %u!", CONFIG_UDP_PORT);
+
+    // One byte more than a packet, so longer datagrams are not mistaken for a truncated valid one.
+    uint8_t buffer[sizeof(udp_packet_t) + 1];
+
+    while (true)
+    {
+        struct sockaddr_in source;
+        socklen_t source_len = sizeof(source);
+
+        int received = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&source, &source_len);
+        if (received < 0)
+        {
+            ESP_LOGW(TAG, "Failed to receive: %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if (received != sizeof(udp_packet_t))
+            continue;
+
+        udp_packet_t packet;
+        memcpy(&packet, buffer, sizeof(packet));
+        udp_handle(&packet, &source);
+    }
+}
+
+static void udp_join_groups()
+{
+    if (server_socket < 0)
+        return;
+
+    for (uint8_t i = 0; MULTICAST_GROUPS[i] != NULL; i++)
+    {
+        struct ip_mreq membership = {
+            .imr_multiaddr.s_addr = inet_addr(MULTICAST_GROUPS[i]),
+            .imr_interface.s_addr = htonl(INADDR_ANY),
+        };
+
+        // Dropping first makes the membership follow the interface that is connected now.
+        setsockopt(server_socket, IPPROTO_IP, IP_DROP_MEMBERSHIP, &membership, sizeof(membership));
+
+        if (setsockopt(server_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0)
+            ESP_LOGW(TAG, "Failed to join group %s: %d", MULTICAST_GROUPS[i], errno);
+        else
+            ESP_LOGI(TAG, "Joined group %s.", MULTICAST_GROUPS[i]);
+    }
+}
+
+static void udp_handle(udp_packet_t *packet, const struct sockaddr_in *source)
+{
+    if (memcmp(packet->magic, UDP_PROTOCOL_MAGIC, sizeof(packet->magic)) != 0 || packet->version != UDP_PROTOCOL_VERSION || (packet->opcode & UDP_OPCODE_ACK))
+        return;
+
+    char source_str[16];
+    inet_ntoa_r(source->sin_addr, source_str, sizeof(source_str));
+
+    // Unauthenticated datagrams are not answered, so the device cannot be used to reflect traffic.
+    if (!udp_verify(packet))
+    {
+        ESP_LOGW(TAG, "Dropped datagram with invalid tag from %s.", source_str);
+        return;
+    }
+
+    // Replays are recognized by time instead of by sender, source addresses are not authenticated.
+    int64_t now;
+    udp_status_t status = udp_check_time(packet->timestamp, &now);
+    uint32_t accepted = 0;
+
+    if (status != UDP_STATUS_OK)
+    {
+        ESP_LOGW(TAG, "Dropped expired datagram from %s.", source_str);
+    }
+    else
+    {
+        bool is_known;
+        udp_replay_entry_t *entry = udp_find_replay(packet, now, &is_known);
+
+        if (entry == NULL)
+        {
+            // Running a command that could not be remembered would allow to replay it.
+            ESP_LOGW(TAG, "Rejected datagram from %s, replay cache is full.", source_str);
+            status = UDP_STATUS_REJECTED;
+        }
+        else if (is_known)
+        {
+            // A retransmission is only acknowledged again, the command already ran.
+            accepted = entry->accepted;
+            status = entry->status;
+        }
+        else
+        {
+            esp_err_t err = controller_dispatch(packet->channels & CONTROLLER_ALL_CHANNELS, packet->opcode, packet->value, true, &accepted);
+
+            ESP_LOGI(TAG, "Command %u for channels 0x%" PRIx32 " from %s, accepted 0x%" PRIx32 ".", packet->opcode, packet->channels, source_str, accepted);
+
+            if (err == ESP_OK)
+                status = UDP_STATUS_OK;
+            else if (err == ESP_ERR_INVALID_ARG)
+                status = UDP_STATUS_INVALID;
+            else
+                status = UDP_STATUS_REJECTED;
+
+            memcpy(entry->tag, packet->tag, UDP_TAG_SIZE);
+            entry->timestamp = packet->timestamp;
+            entry->accepted = accepted;
+            entry->status = status;
+        }
+    }
+
+    packet->opcode |= UDP_OPCODE_ACK;
+    packet->channels = accepted;
+    packet->status = status;
+    udp_sign(packet, packet->tag);
+
+    if (sendto(server_socket, packet, sizeof(*packet), 0, (const struct sockaddr *)source, sizeof(*source)) < 0)
+        ESP_LOGW(TAG, "Failed to send ack to %s: %d", source_str, errno);
+}
+
+static void udp_time_sync_handler(struct timeval *tv)
+{
+    if (!is_time_synced)
+        ESP_LOGI(TAG, "Clock synchronized, accepting commands.");
+
+    is_time_synced = true;
+}
+
+static udp_status_t udp_check_time(int64_t timestamp, int64_t *now_out)
+{
+    if (!is_time_synced)
+        return UDP_STATUS_EXPIRED;
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    int64_t now = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    int64_t boot = now - esp_timer_get_time();
+    *now_out = now;
+
+    // Commands sent before booting may have run already, the replay cache does not survive a reboot.
+    if (timestamp <= boot || timestamp < now - UDP_REPLAY_WINDOW_US || timestamp > now + UDP_REPLAY_WINDOW_US)
+        return UDP_STATUS_EXPIRED;
+
+    return UDP_STATUS_OK;
+}
+
+static udp_replay_entry_t *udp_find_replay(const udp_packet_t *packet, int64_t now, bool *is_known)
+{
+    udp_replay_entry_t *free_entry = NULL;
+
+    for (uint8_t i = 0; i < CONFIG_UDP_REPLAY_CACHE_SIZE; i++)
+    {
+        udp_replay_entry_t *entry = &replay_cache[i];
+
+        if (entry->timestamp == packet->timestamp && !memcmp(entry->tag, packet->tag, UDP_TAG_SIZE))
+        {
+            *is_known = true;
+            return entry;
+        }
+
+        if (free_entry == NULL && entry->timestamp < now - UDP_REPLAY_WINDOW_US)
+            free_entry = entry;
+    }
+
+    *is_known = false;
+    return free_entry;
+}
+
+static void udp_sign(const udp_packet_t *packet, uint8_t tag_out[UDP_TAG_SIZE])
+{
+    uint8_t hmac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)CONFIG_UDP_KEY, strlen(CONFIG_UDP_KEY),
+                    (const uint8_t *)packet, offsetof(udp_packet_t, tag), hmac);
+
+    memcpy(tag_out, hmac, UDP_TAG_SIZE);
+}
+
+static bool udp_verify(const udp_packet_t *packet)
+{
+    uint8_t tag[UDP_TAG_SIZE];
+    udp_sign(packet, tag);
+
+    // Compared in constant time, so the tag cannot be guessed byte by byte.
+    uint8_t difference = 0;
+    for (uint8_t i = 0; i < UDP_TAG_SIZE; i++)
+        difference |= tag[i] ^ packet->tag[i];
+
+    return difference == 0;
+}
@@ -0,0 +1,232 @@
+"""Send commands over the UDP control protocol, stand in for a device and measure command latency.
+
+A datagram is 36 bytes, all little endian: the magic "RC", the version, the opcode, the channel
+bitmask (32 bit), the timestamp (64 bit microseconds since the Unix epoch), the value, the status and
+two reserved bytes, followed by the first 16 bytes of the HMAC-SHA256 over everything before. The
+opcodes are 0 open, 1 close, 2 stop, 3 position and 4 tilt. A device answers with the same datagram,
+the opcode ORed with 0x80, the accepted channels as bitmask and the status 0 ok, 1 invalid,
+2 rejected or 3 expired. Datagrams are retransmitted unchanged until acknowledged. Devices run a
+datagram only once and only within the replay window around its timestamp, so the clock of the sender
+has to be synchronized like the ones of the devices.
+
+    python rcs_udp.py send --host 239.255.82.1 --expect 4 close all
+    python rcs_udp.py serve --channels 7
+    python rcs_udp.py bench --host 127.0.0.1 --count 1000
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import statistics
+import struct
+import time
+
+MAGIC = b"RC"
+VERSION = 2
+OPCODE_ACK = 0x80
+TAG_SIZE = 16
+
+HEADER = struct.Struct("<2sBBIQBB2x")
+PACKET_SIZE = HEADER.size + TAG_SIZE
+
+ACTIONS = {"open": 0, "close": 1, "stop": 2, "position": 3, "tilt": 4}
+STATUS_NAMES = {0: "ok", 1: "invalid", 2: "rejected", 3: "expired"}
+STATUS_EXPIRED = 3
+
+last_timestamp = 0
+
+
+def now_us():
+    return time.time_ns() // 1000
+
+
+def next_timestamp():
+    # Strictly increasing, so two equal commands sent within a microsecond are not taken for a retransmission.
+    global last_timestamp
+    last_timestamp = max(last_timestamp + 1, now_us())
+    return last_timestamp
+
+
+def pack(key, opcode, channels, timestamp, value=0, status=0):
+    header = HEADER.pack(MAGIC, VERSION, opcode, channels, timestamp, value, status)
+    return header + hmac.new(key, header, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def unpack(key, data):
+    if len(data) != PACKET_SIZE:
+        return None
+
+    header, tag = data[: HEADER.size], data[HEADER.size :]
+    if not hmac.compare_digest(tag, hmac.new(key, header, hashlib.sha256).digest()[:TAG_SIZE]):
+        return None
+
+    magic, version, opcode, channels, timestamp, value, status = HEADER.unpack(header)
+    if magic != MAGIC or version != VERSION:
+        return None
+
+    return opcode, channels, timestamp, value, status
+
+
+def open_socket(timeout):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.settimeout(timeout)
+    return sock
+
+
+def send(sock, key, address, opcode, channels, value, expect, retries):
+    """Send one command until `expect` devices acknowledged it, return their acks with the latency in seconds."""
+    timestamp = next_timestamp()
+    packet = pack(key, opcode, channels, timestamp, value)
+    acks = {}
+    start = time.perf_counter()
+
+    for _ in range(retries + 1):
+        sock.sendto(packet, address)
+        deadline = time.perf_counter() + sock.gettimeout()
+
+        while len(acks) < expect and time.perf_counter() < deadline:
+            try:
+                data, source = sock.recvfrom(64)
+            except socket.timeout:
+                break
+
+            ack = unpack(key, data)
+            if ack is None or ack[0] != opcode | OPCODE_ACK or ack[2] != timestamp or source in acks:
+                continue
+
+            acks[source] = (ack[1], ack[4], time.perf_counter() - start)
+
+        if len(acks) >= expect:
+            break
+
+    return acks
+
+
+def parse_channels(text):
+    return 0xFFFFFFFF if text == "all" else int(text, 0)
+
+
+def command_send(args):
+    sock = open_socket(args.timeout)
+    acks = send(sock, args.key.encode(), (args.host, args.port), ACTIONS[args.action], parse_channels(args.channels), args.value, args.expect, args.retries)
+
+    for (host, _), (accepted, status, latency) in sorted(acks.items()):
+        print(f"{host}: {STATUS_NAMES.get(status, status)}, accepted 0x{accepted:x}, {latency * 1000:.2f} ms")
+
+    if len(acks) < args.expect:
+        print(f"{len(acks)} of {args.expect} devices acknowledged")
+        return 1
+
+    return 0
+
+
+def command_serve(args):
+    """Answer like a device with `--channels` channels, without moving anything."""
+    key = args.key.encode()
+    all_channels = (1 << args.channels) - 1
+    window = args.window * 1000
+    start = now_us()
+    # Commands that ran within the replay window by tag, with the accepted channels and the status of their ack.
+    replays = {}
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", args.port))
+
+    for group in args.group:
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, socket.inet_aton(group) + socket.inet_aton("0.0.0.0"))
+
+    print(f"Serving {args.channels} channels on port {args.port}")
+
+    while True:
+        data, source = sock.recvfrom(64)
+        packet = unpack(key, data)
+        if packet is None or packet[0] & OPCODE_ACK:
+            continue
+
+        opcode, channels, timestamp, value, _ = packet
+        now = now_us()
+        tag = data[HEADER.size :]
+
+        replays = {known: result for known, result in replays.items() if result[0] >= now - window}
+
+        if timestamp <= start or abs(timestamp - now) > window:
+            result = (timestamp, 0, STATUS_EXPIRED)
+        elif tag in replays:
+            result = replays[tag]
+        else:
+            valid = opcode in ACTIONS.values() and not (opcode == 3 and value > 100) and not (opcode == 4 and value > 90)
+            result = (timestamp, channels & all_channels if valid else 0, 0 if valid else 1)
+            replays[tag] = result
+
+            if args.verbose:
+                print(f"{source[0]}: opcode {opcode}, channels 0x{channels:x}, value {value}")
+
+        sock.sendto(pack(key, opcode | OPCODE_ACK, result[1], timestamp, value, result[2]), source)
+
+
+def command_bench(args):
+    sock = open_socket(args.timeout)
+    key = args.key.encode()
+    latencies = []
+    lost = 0
+
+    for _ in range(args.count):
+        acks = send(sock, key, (args.host, args.port), ACTIONS["stop"], parse_channels(args.channels), 0, 1, args.retries)
+        if acks:
+            latencies.append(next(iter(acks.values()))[2] * 1000)
+        else:
+            lost += 1
+
+    if not latencies:
+        print("No command was acknowledged")
+        return 1
+
+    latencies.sort()
+    print(f"{len(latencies)} commands, {lost} lost")
+    print(f"min {latencies[0]:.3f} ms, median {statistics.median(latencies):.3f} ms, "
+          f"p99 {latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))]:.3f} ms, max {latencies[-1]:.3f} ms")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=4210)
+    parser.add_argument("--key", default=os.environ.get("RCS_UDP_KEY"), help="CONFIG_SECRET_UDP_KEY of the devices, RCS_UDP_KEY by default")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+
+    send_parser = subparsers.add_parser("send", help="send one command")
+    send_parser.add_argument("--host", required=True, help="device address or multicast group")
+    send_parser.add_argument("--expect", type=int, default=1, help="number of devices that have to acknowledge")
+    send_parser.add_argument("--timeout", type=float, default=0.2, help="seconds to wait before retransmitting")
+    send_parser.add_argument("--retries", type=int, default=5)
+    send_parser.add_argument("action", choices=ACTIONS)
+    send_parser.add_argument("channels", help="bitmask like 0x1f or all")
+    send_parser.add_argument("value", type=int, nargs="?", default=0, help="percent for position, degrees for tilt")
+
+    serve_parser = subparsers.add_parser("serve", help="stand in for a device")
+    serve_parser.add_argument("--channels", type=int, default=7)
+    serve_parser.add_argument("--group", action="append", default=[], help="multicast group to join")
+    serve_parser.add_argument("--window", type=int, default=2000, help="CONFIG_UDP_REPLAY_WINDOW_MS in milliseconds")
+    serve_parser.add_argument("--verbose", action="store_true")
+
+    bench_parser = subparsers.add_parser("bench", help="measure the latency from command to ack")
+    bench_parser.add_argument("--host", required=True)
+    bench_parser.add_argument("--count", type=int, default=1000)
+    bench_parser.add_argument("--channels", default="0", help="channels to stop, none by default")
+    bench_parser.add_argument("--timeout", type=float, default=0.2)
+    bench_parser.add_argument("--retries", type=int, default=5)
+
+    args = parser.parse_args()
+    if not args.key:
+        parser.error("no key given, pass --key or set RCS_UDP_KEY")
+
+    commands = {"send": command_send, "serve": command_serve, "bench": command_bench}
+    return commands[args.command](args)
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "update.h"
+
+#include <stdbool.h>
+
+typedef update_error_t patch_output_func(const void *buffer, size_t buffer_size);
+
+bool patch_detect(const void *buffer, size_t buffer_size);
+
+update_error_t patch_begin();
+update_error_t patch_write(const uint8_t *buffer, size_t buffer_size, patch_output_func *output);
+update_error_t patch_end();
+
+void patch_free();
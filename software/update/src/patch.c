@@ -0,0 +1,293 @@
+#include "update/patch.h"
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+#include <string.h>
+
+#define PATCH_MAGIC "RCSD"
+#define PATCH_MAGIC_SIZE 4
+#define PATCH_HASH_SIZE 32
+#define PATCH_HEADER_SIZE (PATCH_MAGIC_SIZE + 4 + PATCH_HASH_SIZE + 4 + PATCH_HASH_SIZE)
+#define PATCH_RECORD_SIZE 9
+#define PATCH_BLOCK_SIZE 1024
+
+static const char *const TAG = "Update     : Patch    ";
+
+typedef enum patch_op
+{
+    PATCH_OP_ADD,
+    PATCH_OP_INSERT,
+} patch_op_t;
+
+typedef enum patch_state
+{
+    PATCH_STATE_HEADER,
+    PATCH_STATE_RECORD,
+    PATCH_STATE_DATA,
+} patch_state_t;
+
+typedef struct patch
+{
+    patch_state_t state;
+    uint8_t header[PATCH_HEADER_SIZE];
+    size_t header_length;
+
+    const esp_partition_t *source;
+    uint32_t source_size;
+    uint32_t target_size;
+    uint8_t target_hash[PATCH_HASH_SIZE];
+    uint32_t written;
+    mbedtls_sha256_context target_sha;
+
+    patch_op_t op;
+    uint32_t length;
+    uint32_t offset;
+    uint8_t block[PATCH_BLOCK_SIZE];
+} patch_t;
+
+// Only allocated while a patch is applied.
+static patch_t *patch = NULL;
+
+static size_t patch_collect(const uint8_t *, size_t, size_t);
+static update_error_t patch_parse_header();
+static update_error_t patch_parse_record();
+static update_error_t patch_apply(const uint8_t *, size_t, patch_output_func *);
+static update_error_t patch_hash_source(uint8_t *);
+static uint32_t patch_read_u32(const uint8_t *);
+
+bool patch_detect(const void *buffer, size_t buffer_size)
+{
+    return buffer_size >= PATCH_MAGIC_SIZE && !memcmp(buffer, PATCH_MAGIC, PATCH_MAGIC_SIZE);
+}
+
+update_error_t patch_begin()
+{
+    patch = calloc(1, sizeof(patch_t));
+    if (patch == NULL)
+    {
+        ESP_LOGE(TAG, "Not enough memory to apply patch.");
+        return UPDATE_FAILED;
+    }
+
+    patch->source = esp_ota_get_running_partition();
+    mbedtls_sha256_init(&patch->target_sha);
+    mbedtls_sha256_starts(&patch->target_sha, 0);
+
+    ESP_LOGI(TAG, "Apply patch against running firmware.");
+    return UPDATE_OK;
+}
+
+update_error_t patch_write(const uint8_t *buffer, size_t buffer_size, patch_output_func *output)
+{
+    while (buffer_size > 0)
+    {
+        size_t consumed;
+        update_error_t err = UPDATE_OK;
+
+        switch (patch->state)
+        {
+        case PATCH_STATE_HEADER:
+            consumed = patch_collect(buffer, buffer_size, PATCH_HEADER_SIZE);
+            if (patch->header_length == PATCH_HEADER_SIZE)
+                err = patch_parse_header();
+            break;
+
+        case PATCH_STATE_RECORD:
+            consumed = patch_collect(buffer, buffer_size, PATCH_RECORD_SIZE);
+            if (patch->header_length == PATCH_RECORD_SIZE)
+                err = patch_parse_record();
+            break;
+
+        default:
+            consumed = buffer_size < patch->length ? buffer_size : patch->length;
+            err = patch_apply(buffer, consumed, output);
+            break;
+        }
+
+        if (err != UPDATE_OK)
+            return err;
+
+        buffer += consumed;
+        buffer_size -= consumed;
+    }
+
+    return UPDATE_OK;
+}
+
+update_error_t patch_end()
+{
+    uint8_t hash[PATCH_HASH_SIZE];
+
+    if (patch->state != PATCH_STATE_RECORD || patch->header_length != 0 || patch->written != patch->target_size)
+    {
+        ESP_LOGE(TAG, "Patch is truncated. (%" PRIu32 " of %" PRIu32 " bytes)", patch->written, patch->target_size);
+        return UPDATE_ERR_VALIDATION_FAILED;
+    }
+
+    mbedtls_sha256_finish(&patch->target_sha, hash);
+    if (memcmp(hash, patch->target_hash, PATCH_HASH_SIZE))
+    {
+        ESP_LOGE(TAG, "Patched image hash mismatch.");
+        return UPDATE_ERR_VALIDATION_FAILED;
+    }
+
+    ESP_LOGI(TAG, "Patched image verified. (%" PRIu32 " bytes)", patch->written);
+    return UPDATE_OK;
+}
+
+void patch_free()
+{
+    if (patch == NULL)
+        return;
+
+    mbedtls_sha256_free(&patch->target_sha);
+    free(patch);
+    patch = NULL;
+}
+
+static size_t patch_collect(const uint8_t *buffer, size_t buffer_size, size_t size)
+{
+    // Headers may be split across chunks, so they are gathered before being parsed.
+    size_t consumed = size - patch->header_length;
+    if (consumed > buffer_size)
+        consumed = buffer_size;
+
+    memcpy(patch->header + patch->header_length, buffer, consumed);
+    patch->header_length += consumed;
+
+    return consumed;
+}
+
+static update_error_t patch_parse_header()
+{
+    uint8_t source_hash[PATCH_HASH_SIZE];
+
+    patch->source_size = patch_read_u32(patch->header + PATCH_MAGIC_SIZE);
+    patch->target_size = patch_read_u32(patch->header + PATCH_MAGIC_SIZE + 4 + PATCH_HASH_SIZE);
+    memcpy(patch->target_hash, patch->header + PATCH_HEADER_SIZE - PATCH_HASH_SIZE, PATCH_HASH_SIZE);
+
+    if (patch->source_size > patch->source->size)
+    {
+        ESP_LOGE(TAG, "Patch source does not fit into running partition.");
+        return UPDATE_FAILED;
+    }
+
+    // A patch made against another build would produce garbage, so the base is checked first.
+    update_error_t err = patch_hash_source(source_hash);
+    if (err != UPDATE_OK)
+        return err;
+
+    if (memcmp(source_hash, patch->header + PATCH_MAGIC_SIZE + 4, PATCH_HASH_SIZE))
+    {
+        ESP_LOGE(TAG, "Patch was made for a different firmware.");
+        return UPDATE_FAILED;
+    }
+
+    patch->state = PATCH_STATE_RECORD;
+    patch->header_length = 0;
+    return UPDATE_OK;
+}
+
+static update_error_t patch_parse_record()
+{
+    patch->op = patch->header[0];
+    patch->length = patch_read_u32(patch->header + 1);
+    patch->offset = patch_read_u32(patch->header + 5);
+    patch->header_length = 0;
+
+    if (patch->op != PATCH_OP_ADD && patch->op != PATCH_OP_INSERT)
+    {
+        ESP_LOGE(TAG, "Unknown patch record %u.", patch->op);
+        return UPDATE_FAILED;
+    }
+
+    if (patch->op == PATCH_OP_ADD && (patch->offset > patch->source_size || patch->length > patch->source_size - patch->offset))
+    {
+        ESP_LOGE(TAG, "Patch record exceeds source image.");
+        return UPDATE_FAILED;
+    }
+
+    if (patch->length > patch->target_size - patch->written)
+    {
+        ESP_LOGE(TAG, "Patch record exceeds target image.");
+        return UPDATE_FAILED;
+    }
+
+    patch->state = patch->length > 0 ? PATCH_STATE_DATA : PATCH_STATE_RECORD;
+    return UPDATE_OK;
+}
+
+static update_error_t patch_apply(const uint8_t *buffer, size_t buffer_size, patch_output_func *output)
+{
+    while (buffer_size > 0)
+    {
+        size_t size = buffer_size < PATCH_BLOCK_SIZE ? buffer_size : PATCH_BLOCK_SIZE;
+        const uint8_t *data = buffer;
+
+        if (patch->op == PATCH_OP_ADD)
+        {
+            esp_err_t err = esp_partition_read(patch->source, patch->offset, patch->block, size);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to read running partition. (%s)", esp_err_to_name(err));
+                return UPDATE_FAILED;
+            }
+
+            for (size_t i = 0; i < size; i++)
+                patch->block[i] += buffer[i];
+
+            patch->offset += size;
+            data = patch->block;
+        }
+
+        update_error_t err = output(data, size);
+        if (err != UPDATE_OK)
+            return err;
+
+        mbedtls_sha256_update(&patch->target_sha, data, size);
+        patch->written += size;
+        patch->length -= size;
+
+        buffer += size;
+        buffer_size -= size;
+    }
+
+    if (patch->length == 0)
+        patch->state = PATCH_STATE_RECORD;
+
+    return UPDATE_OK;
+}
+
+static update_error_t patch_hash_source(uint8_t *hash)
+{
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    for (uint32_t offset = 0; offset < patch->source_size; offset += PATCH_BLOCK_SIZE)
+    {
+        size_t size = patch->source_size - offset < PATCH_BLOCK_SIZE ? patch->source_size - offset : PATCH_BLOCK_SIZE;
+
+        esp_err_t err = esp_partition_read(patch->source, offset, patch->block, size);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to read running partition. (%s)", esp_err_to_name(err));
+            mbedtls_sha256_free(&sha);
+            return UPDATE_FAILED;
+        }
+
+        mbedtls_sha256_update(&sha, patch->block, size);
+    }
+
+    mbedtls_sha256_finish(&sha, hash);
+    mbedtls_sha256_free(&sha);
+    return UPDATE_OK;
+}
+
+static uint32_t patch_read_u32(const uint8_t *data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
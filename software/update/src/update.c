@@ -1,16 +1,55 @@
 #include "update.h"
+#include "update/patch.h"
 
 #include "config.h"
 
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_ota_ops.h"
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+
+#include <string.h>
+
+#define GZIP_HEADER_SIZE 10
+#define GZIP_TRAILER_SIZE 8
+
+#define GZIP_FLAG_HCRC 0x02
+#define GZIP_FLAG_EXTRA 0x04
+#define GZIP_FLAG_NAME 0x08
+#define GZIP_FLAG_COMMENT 0x10
 
 static const char *const TAG = "Update     ";
 
 static esp_ota_handle_t update_handle;
 static const esp_partition_t *update_partition;
 
+typedef struct update_inflater
+{
+    tinfl_decompressor decompressor;
+    uint8_t dictionary[TINFL_LZ_DICT_SIZE];
+    size_t dictionary_offset;
+    tinfl_status status;
+    uint32_t crc;
+    uint32_t size;
+    uint8_t trailer[GZIP_TRAILER_SIZE];
+    uint8_t trailer_length;
+} update_inflater_t;
+
+// Only allocated while a compressed image is written.
+static update_inflater_t *inflater = NULL;
+static bool update_started = false;
+
+static bool update_patching = false;
+static bool update_output_started = false;
+
+static update_error_t update_output(const void *, size_t);
+static update_error_t update_flash(const void *, size_t);
+static update_error_t update_inflate_begin(const uint8_t *, size_t, size_t *);
+static update_error_t update_inflate(const uint8_t *, size_t, size_t);
+static update_error_t update_inflate_end();
+static void update_inflate_free();
+
 update_error_t update_prepare(size_t image_size)
 {
     if (image_size > CONFIG_UPDATE_PARTITION_SIZE)
@@ -27,6 +66,12 @@ update_error_t update_prepare(size_t image_size)
     }
 
     ESP_LOGI(TAG, "Begin.");
+    update_inflate_free();
+    patch_free();
+    update_started = false;
+    update_output_started = false;
+    update_patching = false;
+
     esp_err_t err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
     if (err != ESP_OK)
     {
@@ -42,12 +87,38 @@ update_error_t update_write(void *buffer, size_t buffer_size, size_t *remaining_
 {
     ESP_LOGI(TAG, "Write next %u bytes. (%u KiB remaining)", buffer_size, *remaining_size / 1024);
 
-    esp_err_t err = esp_ota_write(update_handle, buffer, buffer_size);
-    if (err != ESP_OK)
+    const uint8_t *data = buffer;
+    size_t data_size = buffer_size;
+    update_error_t err;
+
+    // Compressed images are recognized by the gzip magic, plain images start with the ESP image magic.
+    if (!update_started)
     {
-        ESP_LOGE(TAG, "Failed to write to flash partition. (%s)", esp_err_to_name(err));
+        update_started = true;
+
+        if (buffer_size >= 2 && data[0] == 0x1F && data[1] == 0x8B)
+        {
+            size_t header_size;
+
+            err = update_inflate_begin(data, data_size, &header_size);
+            if (err != UPDATE_OK)
+            {
+                esp_ota_abort(update_handle);
+                return err;
+            }
+
+            data += header_size;
+            data_size -= header_size;
+        }
+    }
+
+    err = inflater != NULL ? update_inflate(data, data_size, *remaining_size - buffer_size) : update_output(data, data_size);
+    if (err != UPDATE_OK)
+    {
+        update_inflate_free();
+        patch_free();
         esp_ota_abort(update_handle);
-        return UPDATE_FAILED;
+        return err;
     }
 
     *remaining_size -= buffer_size;
@@ -57,6 +128,30 @@ update_error_t update_write(void *buffer, size_t buffer_size, size_t *remaining_
 update_error_t update_finish()
 {
     ESP_LOGI(TAG, "Finish.");
+
+    if (inflater != NULL && update_inflate_end() != UPDATE_OK)
+    {
+        update_inflate_free();
+        patch_free();
+        esp_ota_abort(update_handle);
+        return UPDATE_ERR_VALIDATION_FAILED;
+    }
+
+    update_inflate_free();
+
+    // The reconstructed image is verified against the hash from the patch before it can be booted.
+    if (update_patching)
+    {
+        update_error_t patch_err = patch_end();
+        patch_free();
+
+        if (patch_err != UPDATE_OK)
+        {
+            esp_ota_abort(update_handle);
+            return patch_err;
+        }
+    }
+
     esp_err_t err = esp_ota_end(update_handle);
     if (err == ESP_ERR_OTA_VALIDATE_FAILED)
     {
@@ -82,6 +177,8 @@ update_error_t update_finish()
 
 void update_abort()
 {
+    update_inflate_free();
+    patch_free();
     esp_ota_abort(update_handle);
 }
 
@@ -99,6 +196,180 @@ void update_mark_valid()
     }
 }
 
+static update_error_t update_output(const void *buffer, size_t buffer_size)
+{
+    // Patches are recognized by their magic after an optional decompression.
+    if (!update_output_started)
+    {
+        update_output_started = true;
+
+        if (patch_detect(buffer, buffer_size))
+        {
+            update_error_t err = patch_begin();
+            if (err != UPDATE_OK)
+                return err;
+
+            update_patching = true;
+        }
+    }
+
+    return update_patching ? patch_write(buffer, buffer_size, &update_flash) : update_flash(buffer, buffer_size);
+}
+
+static update_error_t update_flash(const void *buffer, size_t buffer_size)
+{
+    esp_err_t err = esp_ota_write(update_handle, buffer, buffer_size);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to write to flash partition. (%s)", esp_err_to_name(err));
+        return UPDATE_FAILED;
+    }
+
+    return UPDATE_OK;
+}
+
+static update_error_t update_inflate_begin(const uint8_t *buffer, size_t buffer_size, size_t *header_size_out)
+{
+    // The whole gzip header has to be part of the first chunk.
+    if (buffer_size < GZIP_HEADER_SIZE || buffer[2] != 8)
+    {
+        ESP_LOGE(TAG, "Unsupported gzip header.");
+        return UPDATE_FAILED;
+    }
+
+    uint8_t flags = buffer[3];
+    size_t header_size = GZIP_HEADER_SIZE;
+
+    if (flags & GZIP_FLAG_EXTRA)
+    {
+        if (header_size + 2 > buffer_size)
+            return UPDATE_FAILED;
+
+        header_size += 2 + (buffer[header_size] | buffer[header_size + 1] << 8);
+    }
+
+    if (flags & GZIP_FLAG_NAME)
+    {
+        const uint8_t *end = header_size < buffer_size ? memchr(buffer + header_size, '\0', buffer_size - header_size) : NULL;
+        if (end == NULL)
+            return UPDATE_FAILED;
+
+        header_size = end - buffer + 1;
+    }
+
+    if (flags & GZIP_FLAG_COMMENT)
+    {
+        const uint8_t *end = header_size < buffer_size ? memchr(buffer + header_size, '\0', buffer_size - header_size) : NULL;
+        if (end == NULL)
+            return UPDATE_FAILED;
+
+        header_size = end - buffer + 1;
+    }
+
+    if (flags & GZIP_FLAG_HCRC)
+        header_size += 2;
+
+    if (header_size > buffer_size)
+        return UPDATE_FAILED;
+
+    inflater = malloc(sizeof(update_inflater_t));
+    if (inflater == NULL)
+    {
+        ESP_LOGE(TAG, "Not enough memory to decompress image.");
+        return UPDATE_FAILED;
+    }
+
+    tinfl_init(&inflater->decompressor);
+    inflater->dictionary_offset = 0;
+    inflater->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    inflater->crc = 0;
+    inflater->size = 0;
+    inflater->trailer_length = 0;
+
+    ESP_LOGI(TAG, "Decompress gzip image.");
+    *header_size_out = header_size;
+    return UPDATE_OK;
+}
+
+static update_error_t update_inflate(const uint8_t *buffer, size_t buffer_size, size_t following_size)
+{
+    // The trailer is split off by position before inflating, the ROM inflater may otherwise read parts of it into
+    // its bit buffer where they cannot be recovered from.
+    size_t trailer_size = following_size >= GZIP_TRAILER_SIZE ? 0 : GZIP_TRAILER_SIZE - following_size;
+    if (trailer_size > buffer_size)
+        trailer_size = buffer_size;
+
+    const uint8_t *trailer = buffer + buffer_size - trailer_size;
+    buffer_size -= trailer_size;
+
+    while (inflater->status != TINFL_STATUS_DONE && (buffer_size > 0 || inflater->status == TINFL_STATUS_HAS_MORE_OUTPUT))
+    {
+        uint8_t *output = inflater->dictionary + inflater->dictionary_offset;
+        size_t input_size = buffer_size;
+        size_t output_size = TINFL_LZ_DICT_SIZE - inflater->dictionary_offset;
+
+        // The output buffer doubles as the sliding window, so it is flushed before it wraps around.
+        inflater->status = tinfl_decompress(&inflater->decompressor, buffer, &input_size, inflater->dictionary, output, &output_size, TINFL_FLAG_HAS_MORE_INPUT);
+        if (inflater->status < TINFL_STATUS_DONE)
+        {
+            ESP_LOGE(TAG, "Failed to decompress image. (%d)", inflater->status);
+            return UPDATE_FAILED;
+        }
+
+        buffer += input_size;
+        buffer_size -= input_size;
+
+        if (output_size > 0)
+        {
+            update_error_t err = update_output(output, output_size);
+            if (err != UPDATE_OK)
+                return err;
+
+            inflater->crc = esp_rom_crc32_le(inflater->crc, output, output_size);
+            inflater->size += output_size;
+            inflater->dictionary_offset = (inflater->dictionary_offset + output_size) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+    }
+
+    if (buffer_size > 0)
+    {
+        ESP_LOGE(TAG, "Unexpected data after compressed image.");
+        return UPDATE_FAILED;
+    }
+
+    memcpy(inflater->trailer + inflater->trailer_length, trailer, trailer_size);
+    inflater->trailer_length += trailer_size;
+
+    return UPDATE_OK;
+}
+
+static update_error_t update_inflate_end()
+{
+    if (inflater->status != TINFL_STATUS_DONE || inflater->trailer_length != GZIP_TRAILER_SIZE)
+    {
+        ESP_LOGE(TAG, "Compressed image is truncated.");
+        return UPDATE_FAILED;
+    }
+
+    uint32_t crc = inflater->trailer[0] | inflater->trailer[1] << 8 | inflater->trailer[2] << 16 | (uint32_t)inflater->trailer[3] << 24;
+    uint32_t size = inflater->trailer[4] | inflater->trailer[5] << 8 | inflater->trailer[6] << 16 | (uint32_t)inflater->trailer[7] << 24;
+
+    if (crc != inflater->crc || size != inflater->size)
+    {
+        ESP_LOGE(TAG, "Decompressed image is corrupted.");
+        return UPDATE_FAILED;
+    }
+
+    ESP_LOGI(TAG, "Decompressed %" PRIu32 " bytes.", inflater->size);
+    return UPDATE_OK;
+}
+
+static void update_inflate_free()
+{
+    free(inflater);
+    inflater = NULL;
+}
+
 __attribute__((noreturn)) void update_reboot()
 {
     esp_app_desc_t desc;
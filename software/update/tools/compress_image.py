@@ -0,0 +1,21 @@
+"""Compress a firmware image for OTA updates and report the saved transfer size."""
+
+import gzip
+import sys
+
+
+def main(input_path, output_path):
+    with open(input_path, "rb") as input:
+        image = input.read()
+
+    # A fixed timestamp keeps the artefact reproducible.
+    compressed = gzip.compress(image, compresslevel=9, mtime=0)
+
+    with open(output_path, "wb") as output:
+        output.write(compressed)
+
+    print(f"{output_path}: {len(image)} -> {len(compressed)} bytes ({100 * len(compressed) / len(image):.1f} %)")
+
+
+if __name__ == "__main__":
+    main(*sys.argv[1:])
@@ -0,0 +1,127 @@
+"""Create a compressed delta patch that turns the running firmware image into a new one.
+
+The patch starts with a header of the magic "RCSD", the source size, the source SHA-256, the target
+size and the target SHA-256. It is followed by records of an op code byte, a length and a source
+offset (both 32 bit little endian). An ADD record carries length bytes that are added to the source
+bytes at the offset, an INSERT record carries length literal bytes. Unchanged regions become runs
+of zeros in ADD records, which the gzip compression of the whole patch removes.
+"""
+
+import gzip
+import hashlib
+import struct
+import sys
+
+MAGIC = b"RCSD"
+OP_ADD = 0
+OP_INSERT = 1
+
+BLOCK_SIZE = 16
+INDEX_STEP = 4
+MIN_MATCH = 32
+WINDOW = 32
+
+
+def index_source(source):
+    index = {}
+
+    for offset in range(0, len(source) - BLOCK_SIZE + 1, INDEX_STEP):
+        index.setdefault(source[offset : offset + BLOCK_SIZE], offset)
+
+    return index
+
+
+def find_match(source, target, index, position):
+    offset = index.get(target[position : position + BLOCK_SIZE])
+    if offset is None:
+        return None
+
+    length = BLOCK_SIZE
+    while position + length < len(target) and offset + length < len(source) and target[position + length] == source[offset + length]:
+        length += 1
+
+    return (offset, length) if length >= MIN_MATCH else None
+
+
+def extend_approximate(source, target, offset, position):
+    # Keep following the source while at least half of the recent bytes still match.
+    length = 0
+    last_equal = 0
+    window_equal = 0
+
+    while position + length < len(target) and offset + length < len(source):
+        if target[position + length] == source[offset + length]:
+            window_equal += 1
+            last_equal = length + 1
+
+        if length >= WINDOW and target[position + length - WINDOW] == source[offset + length - WINDOW]:
+            window_equal -= 1
+
+        length += 1
+
+        if length >= WINDOW and window_equal < WINDOW // 2:
+            break
+
+    return last_equal
+
+
+def diff(source, target):
+    index = index_source(source)
+    records = []
+    literal_start = 0
+    position = 0
+
+    while position < len(target):
+        match = find_match(source, target, index, position)
+        if match is None:
+            position += 1
+            continue
+
+        offset, _ = match
+
+        # Matches are only found at indexed source offsets, so they may start earlier.
+        while position > literal_start and offset > 0 and target[position - 1] == source[offset - 1]:
+            position -= 1
+            offset -= 1
+
+        if position > literal_start:
+            records.append((OP_INSERT, 0, target[literal_start:position]))
+
+        length = extend_approximate(source, target, offset, position)
+        data = bytes((target[position + i] - source[offset + i]) & 0xFF for i in range(length))
+        records.append((OP_ADD, offset, data))
+
+        position += length
+        literal_start = position
+
+    if literal_start < len(target):
+        records.append((OP_INSERT, 0, target[literal_start:]))
+
+    return records
+
+
+def main(source_path, target_path, patch_path):
+    with open(source_path, "rb") as source_file:
+        source = source_file.read()
+
+    with open(target_path, "rb") as target_file:
+        target = target_file.read()
+
+    patch = bytearray(MAGIC)
+    patch += struct.pack("<I", len(source)) + hashlib.sha256(source).digest()
+    patch += struct.pack("<I", len(target)) + hashlib.sha256(target).digest()
+
+    records = diff(source, target)
+    for op, offset, data in records:
+        patch += struct.pack("<BII", op, len(data), offset) + data
+
+    compressed = gzip.compress(bytes(patch), compresslevel=9, mtime=0)
+
+    with open(patch_path, "wb") as patch_file:
+        patch_file.write(compressed)
+
+    print(f"{patch_path}: {len(target)} -> {len(compressed)} bytes ({100 * len(compressed) / len(target):.1f} %, {len(records)} records)")
+
+
+if __name__ == "__main__":
+    main(*sys.argv[1:])